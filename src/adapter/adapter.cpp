@@ -14,12 +14,17 @@
 #include <AdcDriver.h>
 #include <led.h>
 #include <adaptertypes.h>
+#include <cmdlexer.h>
 
 using namespace std;
 using namespace util;
 
-static string CmdBuffer(RX_CMD_LEN);
+static CmdLexer  CmdBuffers[2];            // Receiving and completed commands
+static CmdLexer* RxCmd   = &CmdBuffers[0]; // Fed by UART receive callback
+static CmdLexer* UserCmd = &CmdBuffers[1]; // The last completed command
 static CmdUart* glblUart;
+static volatile bool CmdInProgress; // AdptOnCmd() is running
+static volatile bool CmdAborted;    // Got a character while running
 
 /**
  * Enable the clocks and peripherals, initialize the drivers
@@ -27,6 +32,7 @@ static CmdUart* glblUart;
 static void SetAllRegisters()
 {
     Timer::configure();
+    Clock::start();
     GPIOConfigure(0);
     GPIOConfigure(1);
     CmdUart::configure();
@@ -41,11 +47,16 @@ static void SetAllRegisters()
  */
 static bool UserUartRcvHandler(uint8_t ch)
 {
-    static string cmdBuffer(RX_BUFFER_LEN);
     bool ready = false;
     
-    if (cmdBuffer.length() >= (RX_BUFFER_LEN - 1)) {
-        cmdBuffer.resize(0); // Truncate it
+    // Any character stops the command in progress and is discarded
+    if (CmdInProgress) {
+        CmdAborted = true;
+        return false;
+    }
+
+    if (RxCmd->isFull()) {
+        RxCmd->reset(); // Truncate it
     }
 
     if (AdapterConfig::instance()->getBoolProperty(PAR_ECHO) && ch != '\n') {
@@ -55,13 +66,15 @@ static bool UserUartRcvHandler(uint8_t ch)
         }
     }
     
-    if (ch == '\r') { // Got cmd terminator
-        CmdBuffer = cmdBuffer;
-        cmdBuffer.resize(0);
+    if (ch == '\r') { // Got cmd terminator, the command is parsed already
+        CmdLexer* cmd = UserCmd;
+        UserCmd = RxCmd;
+        RxCmd = cmd;
+        RxCmd->reset();
         ready = true;
     }
     else if (isprint(ch)) { // this will skip '\n' as well
-        cmdBuffer += ch;
+        RxCmd->put(ch);
     }
     
     return ready;
@@ -76,6 +89,42 @@ void AdptSendString(const util::string& str)
     glblUart->send(str);
 }
 
+/**
+ * Send string constant to UART
+ * @param[in] str String to send
+ */
+void AdptSendString(const char* str)
+{
+    glblUart->send(str, strlen(str));
+}
+
+/**
+ * Get the UART transmit buffer to format the output in place
+ * @return The buffer of TX_BUFFER_LEN size
+ */
+char* AdptGetTxBuffer()
+{
+    return glblUart->txBuffer();
+}
+
+/**
+ * Send the UART transmit buffer content
+ * @param[in] len The content length
+ */
+void AdptSendTxBuffer(uint32_t len)
+{
+    glblUart->transmit(len);
+}
+
+/**
+ * Check if the host interrupted the current command
+ * @return true if any character was received while command was running
+ */
+bool AdptIsAborted()
+{
+    return CmdAborted;
+}
+
 const int UART_SPEED = 115200;
 
 /**
@@ -92,7 +141,17 @@ static void AdapterRun()
     for(;;) {    
         if (glblUart->ready()) {
             glblUart->ready(false);
-            AdptOnCmd(CmdBuffer);
+            CmdAborted = false;
+            CmdInProgress = true;
+            AdptOnCmd(*UserCmd);
+            CmdInProgress = AdptIsPolling(); // Any character stops polling
+        }
+        else if (AdptIsPolling()) {
+            AdptOnPoll();
+            CmdInProgress = AdptIsPolling();
+        }
+        else {
+            AdptOnIdle();
         }
         //__WFI(); // goto sleep
     }
@@ -15,16 +15,39 @@ const uint64_t onebit = 1;
 // Configuration settings, storing/retrieving properties
 //
 
-AdapterConfig::AdapterConfig() : values_(0)
+AdapterConfig::AdapterConfig() : values_(0), numOfListeners_(0)
 {
     memset(intProps_, 0, sizeof(intProps_));
 }
+
+/**
+ * Register for the property change notifications
+ * @param[in] listener The listener to add
+ */
+void AdapterConfig::addListener(ConfigListener* listener)
+{
+    if (numOfListeners_ < LISTENERS_LEN) {
+        listeners_[numOfListeners_++] = listener;
+    }
+}
+
+/**
+ * Let the listeners rebuild the state derived from property
+ * @param[in] id The changed property
+ */
+void AdapterConfig::notify(int id)
+{
+    for (int i = 0; i < numOfListeners_; i++) {
+        listeners_[i]->onConfigChange(id);
+    }
+}
     
 void AdapterConfig::setBoolProperty(int id, bool val)
 {
     if (id > 64) 
         return;
     values_ = val ? (values_ | (onebit << id)) : (values_ & ~(onebit << id));
+    notify(id);
 }
 
 bool AdapterConfig::getBoolProperty(int id) const
@@ -38,6 +61,7 @@ void AdapterConfig::setIntProperty(int id, uint32_t val)
 {
     int idx = id - INT_PROPS_START;
     intProps_[idx] = val;
+    notify(id);
 }
 
 uint32_t AdapterConfig::getIntProperty(int id) const
@@ -50,6 +74,7 @@ void AdapterConfig::setBytesProperty(int id, const ByteArray* bytes)
 {
     int idx = id - BYTES_PROPS_START;
     bytesProps_[idx] = *bytes;
+    notify(id);
 }
 
 const ByteArray* AdapterConfig::getBytesProperty(int id) const
@@ -11,6 +11,7 @@
 #include <cstdint>
 #include <cstring>
 #include <lstring.h>
+#include <stringview.h>
 #include <adapterdefs.h>
 
 using namespace std;
@@ -21,6 +22,12 @@ const int OBD_IN_MSG_LEN  = OBD_IN_MSG_DLEN + 5; // 7 data + 4 header + 1 reserv
 const int RX_BUFFER_LEN   = 100; 
 const int RX_CMD_LEN      = 20;         // The incoming cmd
 const int USER_BUF_LEN    = RX_CMD_LEN; // The previous cmd
+const int REPLY_LEN       = 64;         // History dump line
+const int CAN_HISTORY_LEN = 64;         // CAN frames kept for ATBD, 16 bytes each
+const int POLL_LIST_LEN   = 8;          // Requests polled by the adapter
+const int AGGREGATE_SLOTS_LEN = 4;      // Monitored CAN IDs, CAN filter banks 1..4
+const int SNAPSHOT_LEN    = 32;         // CAN IDs in the latest value table, 28 bytes each
+const int PERIODIC_TX_LEN = 4;          // User defined periodic frames
 
 //
 // Command dispatch values
@@ -69,6 +76,41 @@ enum AT_Requests {
 	PAR_CAN_SEND_RTR,
 	PAR_CAN_VAIDATE_DLC,
 	PAR_J1939_MONITOR,
+    PAR_ALLOC_STATS,
+    PAR_BUFFER_DUMP_ID,
+    PAR_BUFFER_DUMP_LAST,
+    PAR_BUFFER_DUMP_RX,
+    PAR_BUFFER_DUMP_TX,
+    PAR_TRIGGER_STATUS,
+    PAR_TRIGGER_OFF,
+    PAR_TRIGGER_ID,
+    PAR_TRIGGER_DATA,
+    PAR_TRIGGER_NEGATIVE,
+    PAR_TRIGGER_BUS_ERROR,
+    PAR_TRIGGER_TIMEOUT,
+    PAR_TRIGGER_POST,
+    PAR_POLL_ADD,
+    PAR_POLL_CLEAR,
+    PAR_POLL_DEADBAND,
+    PAR_POLL_DELETE,
+    PAR_POLL_HEARTBEAT,
+    PAR_POLL_LIST,
+    PAR_POLL_ON_CHANGE,
+    PAR_POLL_START,
+    PAR_AGGR_ADD,
+    PAR_AGGR_CLEAR,
+    PAR_AGGR_DELETE,
+    PAR_AGGR_START,
+    PAR_SNAPSHOT_CENSUS,
+    PAR_SNAPSHOT_CLEAR,
+    PAR_SNAPSHOT_DUMP,
+    PAR_SNAPSHOT_ON,
+    PAR_TX_ADD,
+    PAR_TX_CLEAR,
+    PAR_TX_DELETE,
+    PAR_TX_LIST,
+    PAR_TX_START,
+    PAR_TX_STOP,
     // int properties
     PAR_CAN_CF = INT_PROPS_START,
     PAR_CAN_CM,
@@ -82,6 +124,7 @@ enum AT_Requests {
 	PAR_SET_BRD,
     PAR_TIMEOUT,
     PAR_WAKEUP_VAL,
+    PAR_LOAD_CEILING,
     // bytes properties
     PAR_HEADER_BYTES = BYTES_PROPS_START,
     PAR_CAN_FLOW_CTRL_DAT,
@@ -97,11 +140,19 @@ struct ByteArray {
     uint8_t length;
 };
 
+// Receives the configuration change notifications
+//
+class ConfigListener {
+public:
+    virtual void onConfigChange(int parameter) = 0;
+};
+
 // Configuration settings
 //
 class AdapterConfig {
 public:
     static AdapterConfig* instance();
+    void     addListener(ConfigListener* listener);
     void     setBoolProperty(int parameter, bool val);
     bool     getBoolProperty(int parameter) const;
     void     setIntProperty(int parameter,  uint32_t val);
@@ -110,14 +161,18 @@ public:
     const    ByteArray* getBytesProperty(int parameter) const;
 private:
     const static int BYTE_PROP_LEN  = 10;
-    const static int INT_PROP_LEN   = 10;
+    const static int INT_PROP_LEN   = 13;
     const static int BYTES_PROP_LEN = 10;
+    const static int LISTENERS_LEN  = 4;
 
     AdapterConfig();
+    void notify(int parameter);
     uint64_t   values_;
     uint8_t    byteProps_ [BYTE_PROP_LEN];
     uint32_t   intProps_  [INT_PROP_LEN];
     ByteArray  bytesProps_[BYTES_PROP_LEN];
+    ConfigListener* listeners_[LISTENERS_LEN];
+    int        numOfListeners_;
 };
 
 union NumericType
@@ -134,12 +189,24 @@ union NumericType
     }
 };
 
+class CmdLexer;
+
 void AdptSendString(const util::string& str);
+void AdptSendString(const char* str);
+char* AdptGetTxBuffer();
+void AdptSendTxBuffer(uint32_t len);
 void AdptSendReply(const util::string& str);
+void AdptSendReply(const char* str);
 void AdptDispatcherInit();
-void AdptOnCmd(util::string& cmdString);
+void AdptOnCmd(const CmdLexer& cmd);
+bool AdptIsPolling();
+void AdptOnPoll();
+void AdptOnIdle();
+void AdptSetReplyTag(const char* tag);
+const char* AdptGetReplyTag();
 void AdptReadSerialNum();
 void AdptPowerModeConfigure();
+bool AdptIsAborted();
 
 // Utilities
 void Delay1ms(uint32_t value);
@@ -147,7 +214,7 @@ void Delay1us(uint32_t value);
 void CanIDToString(uint32_t num, util::string& str, bool extended)
 ;
 
-uint32_t to_bytes(const util::string& str, uint8_t* bytes);
+uint32_t to_bytes(const util::string_view& str, uint8_t* bytes);
 void to_ascii(const uint8_t* bytes, uint32_t length, util::string& str);
 
 // LEDs
@@ -0,0 +1,75 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include <cctype>
+#include "cmdlexer.h"
+
+using namespace std;
+using namespace util;
+
+/**
+ * Construct CmdLexer object
+ */
+CmdLexer::CmdLexer()
+{
+    reset();
+}
+
+/**
+ * Start the new command
+ */
+void CmdLexer::reset()
+{
+    cmd_.resize(0);
+    nibble_ = 0;
+    isHex_ = true;
+}
+
+/**
+ * Add the next character, convert it to uppercase, drop spaces
+ * and decode the hex digits on the fly
+ * @param[in] ch Printable character received from UART
+ */
+void CmdLexer::put(char ch)
+{
+    if (ch == ' ')
+        return;
+    
+    ch = toupper(ch);
+    cmd_ += ch;
+
+    if (!isHex_)
+        return;
+    if (!isxdigit(ch)) {
+        isHex_ = false;
+        return;
+    }
+    
+    uint8_t nibble = isdigit(ch) ? (ch - '0') : (ch - 'A' + 10);
+    uint32_t len = cmd_.length();
+    if (len % 2) { 
+        nibble_ = nibble << 4;
+    }
+    else if (len <= sizeof(bytes_) * 2) { // Longer requests are rejected anyway
+        bytes_[len / 2 - 1] = nibble_ | nibble;
+    }
+}
+
+/**
+ * Classify the command
+ * @return The command type
+ */
+int CmdLexer::type() const
+{
+    if (cmd_.empty())
+        return CMD_EMPTY;
+    if (isHex_)
+        return (cmd_.length() % 2) ? CMD_INVALID : CMD_HEX;
+    if (cmd_.length() >= 2 && cmd_[0] == 'A' && cmd_[1] == 'T')
+        return CMD_AT;
+    return CMD_INVALID;
+}
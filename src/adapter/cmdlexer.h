@@ -0,0 +1,40 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#ifndef __CMD_LEXER_H__
+#define __CMD_LEXER_H__
+
+#include <adaptertypes.h>
+
+//
+// The user command, parsed as characters arrive from UART
+//
+class CmdLexer {
+public:
+    enum CmdType {
+        CMD_EMPTY,
+        CMD_AT,
+        CMD_HEX,
+        CMD_INVALID
+    };
+    CmdLexer();
+    void reset();
+    void put(char ch);
+    int type() const;
+    bool empty() const { return cmd_.empty(); }
+    bool isFull() const { return cmd_.length() >= (RX_BUFFER_LEN - 1); }
+    const util::string& command() const { return cmd_; }
+    const uint8_t* bytes() const { return bytes_; }
+    int length() const { return cmd_.length() / 2; }
+private:
+    util::fixed_string<RX_BUFFER_LEN> cmd_; // Uppercase, no spaces
+    uint8_t bytes_[OBD_IN_MSG_LEN];         // Decoded hex bytes
+    uint8_t nibble_;                        // The pending high nibble
+    bool    isHex_;                         // Only hex digits so far
+};
+
+#endif //__CMD_LEXER_H__
@@ -7,32 +7,61 @@
 
 #include <climits>
 #include <cstdio>
+#include <cstdlib>
 #include <adaptertypes.h>
+#include <cmdlexer.h>
 #include "obd/obdprofile.h"
+#include "obd/canhistory.h"
+#include "obd/pidscheduler.h"
+#include "obd/canaggregator.h"
+#include "obd/canmonitor.h"
+#include "obd/canbusmeter.h"
+#include "obd/canpacer.h"
+#include "obd/cantxscheduler.h"
 #include <algorithms.h>
+#include <allocstats.h>
 #include <CmdUart.h>
 #include <AdcDriver.h>
 
 using namespace util;
 
+//#define DISPATCH_VALIDATE
+//#define ALLOC_CHECK // Abort if the repeated OBD request allocates, manual debug check only
+
 //
 // Reply string constants
 //
 static const char ErrMessage [] = "?";
 static const char OkMessage  [] = "OK";
+static const char StopMessage[] = "STOPPED";
 static const char Version    [] = "1.10";
 static const char Interface  [] = "ELM329 v2.1";
 static const char Copyright  [] = "Copyright (c) 2009-2016 ObdDiag.Net";
 static const char Copyright2 [] = "This is free software; see the source for copying conditions. There is NO";
 static const char Copyright3 [] = "warranty; not even for MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.";
 
+static const char* ReplyTag = ""; // The reply lines prefix
+
+
+/**
+ * Convert the hex command argument
+ * @param[in] str The argument
+ * @param[out] val The result value
+ * @return true if the argument is the valid hex number, false otherwise
+ */
+static bool ToHexValue(const string_view& str, uint32_t& val)
+{
+    uint32_t pos = 0;
+    val = stoul(str, &pos, 16);
+    return pos > 0 && pos == str.length();
+}
 
 /**
  * Store the boolean true property
  * @param[in] cmd Command line, ignored
  * @param[in[ par The number in dispatch table
  */
-static void OnSetValueTrue(const string& cmd, int par)
+static void OnSetValueTrue(const string_view& cmd, int par)
 {
     AdapterConfig::instance()->setBoolProperty(par, true);
     AdptSendReply(OkMessage);
@@ -43,7 +72,7 @@ static void OnSetValueTrue(const string& cmd, int par)
  * @param[in[ cmd Command line, ignored
  * @param[in] par The number in dispatch table
  */
-static void OnSetValueFalse(const string& cmd, int par)
+static void OnSetValueFalse(const string_view& cmd, int par)
 {
     AdapterConfig::instance()->setBoolProperty(par, false);
     AdptSendReply(OkMessage);
@@ -54,7 +83,7 @@ static void OnSetValueFalse(const string& cmd, int par)
  * @param[in] cmd Command line
  * @param[in] par The number in dispatch table
  */
-static void OnSetValueInt(const string& cmd, int par)
+static void OnSetValueInt(const string_view& cmd, int par)
 {
     uint32_t val = stoul(cmd, 0, 16);
     if (val != ULONG_MAX) {
@@ -71,7 +100,7 @@ static void OnSetValueInt(const string& cmd, int par)
  * @param[in] cmd Command line
  * @param[in] par The number in dispatch table
  */
-static void OnResetValueInt(const string& cmd, int par)
+static void OnResetValueInt(const string_view& cmd, int par)
 {
     AdapterConfig::instance()->setIntProperty(par, 0);
     AdptSendReply(OkMessage);
@@ -82,22 +111,23 @@ static void OnResetValueInt(const string& cmd, int par)
  * @param[in] cmd Command line
  * @param[in] par The number in dispatch table
  */
-static void OnSetBytes(const string& cmd, int par)
+static void OnSetBytes(const string_view& cmd, int par)
 {
-    string cmdData = cmd;
-    bool sts = false;
     ByteArray bytes;
     
-    if (cmdData.length() == 3) {
-        cmdData = "0" + cmdData; //1.5 bytes
-        sts = to_bytes(cmdData, bytes.data);
+    if (cmd.length() == 3) { //1.5 bytes
+        int nibble = to_digit(cmd[0]);
+        bytes.length = (nibble >= 0) ? to_bytes(cmd.substr(1), bytes.data + 1) : 0;
+        if (bytes.length) {
+            bytes.data[0] = nibble;
+            bytes.length++;
+        }
     }
     else {
-        sts = to_bytes(cmdData, bytes.data);
+        bytes.length = to_bytes(cmd, bytes.data);
     }
     
-    if (sts) {
-        bytes.length = cmdData.length() / 2;
+    if (bytes.length) {
         AdapterConfig::instance()->setBytesProperty(par, &bytes);
         AdptSendReply(OkMessage);
     }
@@ -111,14 +141,22 @@ static void OnSetBytes(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnSetOK(const string& cmd, int par)
+static void OnSetOK(const string_view& cmd, int par)
 {
     AdptSendReply(OkMessage);
 }
 
-static void OnCanShowStatus(const string& cmd, int par)
+/**
+ * The CAN error counters, overflows and the bus load
+ * @param[in] cmd Command line, ignored
+ * @param[in] par The number in dispatch table, ignored
+ */
+static void OnCanShowStatus(const string_view& cmd, int par)
 {
-	return;
+    CanBusMeter* meter = CanBusMeter::instance();
+    meter->step();
+    meter->sendStatus();
+    CanPacer::instance()->sendStatus();
 }
 
 /**
@@ -126,7 +164,7 @@ static void OnCanShowStatus(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnSendReplyCopyright(const string& cmd, int par)
+static void OnSendReplyCopyright(const string_view& cmd, int par)
 {
     AdptSendReply(Copyright);
     AdptSendReply(Copyright2);
@@ -138,7 +176,7 @@ static void OnSendReplyCopyright(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnWiringTest(const string& cmd, int par)
+static void OnWiringTest(const string_view& cmd, int par)
 {
     OBDProfile::instance()->wiringCheck();
 }
@@ -148,7 +186,7 @@ static void OnWiringTest(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnGetSerial(const string& cmd, int par)
+static void OnGetSerial(const string_view& cmd, int par)
 {
     AdptReadSerialNum();
 }
@@ -158,19 +196,350 @@ static void OnGetSerial(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnSendReplyVersion(const string& cmd, int par)
+static void OnSendReplyVersion(const string_view& cmd, int par)
 {
     AdptSendReply(Version);
 }
 
 /**
- * Dump the transmit/receive adapter buffer, "ATBD"
+ * Dump the transmit/receive adapter buffer, "ATBD". The variants are 
+ * "ATBDL nn" - the last nn frames, "ATBDI hhh[hhh]" - one ID or ID range,
+ * "ATBDR" - received only, "ATBDS" - sent only
+ * @param[in] cmd Command line
+ * @param[in] par The number in dispatch table
+ */
+static void OnBufferDump(const string_view& cmd, int par)
+{
+    HistoryFilter filter;
+    bool sts = true;
+    
+    switch (par) {
+        case PAR_BUFFER_DUMP_LAST:
+            sts = ToHexValue(cmd, filter.last);
+            break;
+        case PAR_BUFFER_DUMP_ID:
+            if (cmd.length() == 3 || cmd.length() == 8) {
+                sts = ToHexValue(cmd, filter.idFrom);
+                filter.idTo = filter.idFrom;
+            }
+            else { // The range, two IDs of the same length
+                int len = cmd.length() / 2;
+                sts = ToHexValue(cmd.substr(0, len), filter.idFrom) &&
+                      ToHexValue(cmd.substr(len), filter.idTo) && (filter.idFrom <= filter.idTo);
+            }
+            break;
+        case PAR_BUFFER_DUMP_RX:
+            filter.dir = HistoryFilter::DIR_RX;
+            break;
+        case PAR_BUFFER_DUMP_TX:
+            filter.dir = HistoryFilter::DIR_TX;
+            break;
+    }
+    
+    if (!sts) {
+        AdptSendReply(ErrMessage);
+        return;
+    }
+    OBDProfile::instance()->dumpBuffer(filter);    
+}
+
+/**
+ * Arm the capture trigger, the history is frozen around the event. 
+ * "ATTRI hhh" - ID, "ATTRD dd..mm.." - data pattern and mask, "ATTRN" - negative 
+ * response, "ATTRE" - bus error, "ATTRT" - timeout, "ATTRP hh" - the frames
+ * after trigger, "ATTR0" - off, "ATTR" - the trigger status
+ * @param[in] cmd Command line
+ * @param[in] par The number in dispatch table
+ */
+static void OnTrigger(const string_view& cmd, int par)
+{
+    static const char* const States[] = { "OFF", "ARMED", "TRIGGERED", "FROZEN" };
+    CanHistory* history = CanHistory::instance();
+    HistoryTrigger trigger = history->trigger();
+    bool sts = true;
+    
+    switch (par) {
+        case PAR_TRIGGER_STATUS: {
+            char out[20];
+            int state = history->triggerState();
+            sprintf(out, "%s %04X", States[state], history->triggerSeq() & 0xFFFF);
+            AdptSendReply(state >= CanHistory::TRIG_FIRED ? out : States[state]);
+            return;
+        }
+        case PAR_TRIGGER_OFF:
+            history->disarm();
+            AdptSendReply(OkMessage);
+            return;
+        case PAR_TRIGGER_POST:
+            sts = ToHexValue(cmd, trigger.postFrames) && trigger.postFrames < CAN_HISTORY_LEN;
+            break;
+        case PAR_TRIGGER_ID:
+            trigger.type = HistoryTrigger::TRIG_ID;
+            sts = ToHexValue(cmd, trigger.id);
+            break;
+        case PAR_TRIGGER_DATA: { // The data and mask of the same length
+            int len = cmd.length() / 2;
+            trigger.type = HistoryTrigger::TRIG_DATA;
+            memset(trigger.data, 0, sizeof(trigger.data));
+            memset(trigger.mask, 0, sizeof(trigger.mask));
+            sts = (len % 2) == 0 && to_bytes(cmd.substr(0, len), trigger.data) &&
+                  to_bytes(cmd.substr(len), trigger.mask);
+            break;
+        }
+        case PAR_TRIGGER_NEGATIVE:
+            trigger.type = HistoryTrigger::TRIG_NEGATIVE;
+            break;
+        case PAR_TRIGGER_BUS_ERROR:
+            trigger.type = HistoryTrigger::TRIG_BUS_ERROR;
+            break;
+        case PAR_TRIGGER_TIMEOUT:
+            trigger.type = HistoryTrigger::TRIG_TIMEOUT;
+            break;
+    }
+    
+    if (!sts) {
+        AdptSendReply(ErrMessage);
+        return;
+    }
+    
+    if (par == PAR_TRIGGER_POST) {
+        history->setPostFrames(trigger.postFrames);
+    }
+    else {
+        history->arm(trigger);
+    }
+    AdptSendReply(OkMessage);
+}
+
+/**
+ * The adapter polled requests, "AT#PA<period><request>" adds the request with
+ * the period in ms, "AT#PD<slot>" deletes, "AT#PC" clears, "AT#PL" lists and
+ * "AT#PS" starts polling till any character is received. "AT#PO1" turns on
+ * report on change mode with "AT#PB<slot><deadband>" and "AT#PH<heartbeat ms>".
+ * The requests are paced to the bus load ceiling "AT#LC<hex %>", "AT#LC" is off.
+ * The other traffic is the whole bus load of the last second as counted by 
+ * the meter catch-all filter, the frames lost to the receive overruns are
+ * not counted.
+ * @param[in] cmd Command line
+ * @param[in] par The number in dispatch table
+ */
+static void OnPoll(const string_view& cmd, int par)
+{
+    PidScheduler* scheduler = PidScheduler::instance();
+    bool sts = true;
+    
+    switch (par) {
+        case PAR_POLL_ADD: {
+            uint32_t period = 0;
+            uint8_t data[OBD_IN_MSG_DLEN];
+            int len = to_bytes(cmd.substr(4), data);
+            int slot = -1;
+            if (ToHexValue(cmd.substr(0, 4), period) && len) {
+                slot = scheduler->add(period, data, len);
+            }
+            if (slot >= 0) {
+                char out[4];
+                sprintf(out, "%X", slot);
+                AdptSendReply(out);
+                return;
+            }
+            sts = false;
+            break;
+        }
+        case PAR_POLL_DELETE: {
+            int slot = to_digit(cmd[0]);
+            sts = scheduler->remove(slot);
+            break;
+        }
+        case PAR_POLL_CLEAR:
+            scheduler->clear();
+            break;
+        case PAR_POLL_DEADBAND: {
+            uint32_t deadband = 0;
+            sts = ToHexValue(cmd.substr(1), deadband) && scheduler->setDeadband(to_digit(cmd[0]), deadband);
+            break;
+        }
+        case PAR_POLL_HEARTBEAT: {
+            uint32_t heartbeat = 0;
+            sts = ToHexValue(cmd, heartbeat) && heartbeat <= PidScheduler::MAX_PERIOD;
+            if (sts) {
+                scheduler->setHeartbeat(heartbeat);
+            }
+            break;
+        }
+        case PAR_POLL_ON_CHANGE:
+            sts = (cmd[0] == '0' || cmd[0] == '1');
+            if (sts) {
+                scheduler->setOnChange(cmd[0] == '1');
+            }
+            break;
+        case PAR_POLL_LIST:
+            scheduler->list();
+            return;
+        case PAR_POLL_START:
+            sts = scheduler->start();
+            if (sts) {
+                CanAggregator::instance()->start();
+            }
+            break;
+    }
+    AdptSendReply(sts ? OkMessage : ErrMessage);
+}
+
+/**
+ * The monitored CAN ID aggregation, "AT#AA<id><bit><bits><window>" adds
+ * the slot for 3 or 8 hex digits ID, the field first bit and length and
+ * the window in ms. "AT#AD<slot>" deletes, "AT#AC" clears and "AT#AS" starts 
+ * till any character is received, "AT#PS" starts it with the polling.
+ * @param[in] cmd Command line
+ * @param[in] par The number in dispatch table
+ */
+static void OnAggregate(const string_view& cmd, int par)
+{
+    CanAggregator* aggregator = CanAggregator::instance();
+    bool sts = true;
+    
+    switch (par) {
+        case PAR_AGGR_ADD: {
+            int idLen = cmd.length() - 8;
+            uint32_t id = 0, pos = 0, bits = 0, window = 0;
+            int slot = -1;
+            if (ToHexValue(cmd.substr(0, idLen), id) && ToHexValue(cmd.substr(idLen, 2), pos) &&
+                ToHexValue(cmd.substr(idLen + 2, 2), bits) && ToHexValue(cmd.substr(idLen + 4), window)) {
+                slot = aggregator->add(id, idLen > 3, pos, bits, window);
+            }
+            if (slot >= 0) {
+                char out[4];
+                sprintf(out, "%X", slot);
+                AdptSendReply(out);
+                return;
+            }
+            sts = false;
+            break;
+        }
+        case PAR_AGGR_DELETE:
+            sts = aggregator->remove(to_digit(cmd[0]));
+            break;
+        case PAR_AGGR_CLEAR:
+            aggregator->clear();
+            break;
+        case PAR_AGGR_START:
+            sts = aggregator->start();
+            break;
+    }
+    AdptSendReply(sts ? OkMessage : ErrMessage);
+}
+
+/**
+ * The latest value per CAN ID table, "AT#SN1" turns on the snapshot of all
+ * bus frames, "AT#SN0" off, "AT#SD" displays the table, "AT#SD<id>" 
+ * the ID entry, "AT#SS" the ID census and "AT#SC" clears it
+ * @param[in] cmd Command line
+ * @param[in] par The number in dispatch table
+ */
+static void OnSnapshot(const string_view& cmd, int par)
+{
+    CanMonitor* monitor = CanMonitor::instance();
+    bool sts = true;
+    
+    switch (par) {
+        case PAR_SNAPSHOT_ON:
+            sts = (cmd[0] == '0' || cmd[0] == '1');
+            if (sts) {
+                monitor->setSnapshot(cmd[0] == '1');
+            }
+            break;
+        case PAR_SNAPSHOT_CLEAR:
+            monitor->clear();
+            break;
+        case PAR_SNAPSHOT_CENSUS:
+            monitor->census();
+            return;
+        case PAR_SNAPSHOT_DUMP: {
+            uint32_t id = 0;
+            if (cmd.empty()) {
+                monitor->dump();
+                return;
+            }
+            if (ToHexValue(cmd, id) && monitor->dump(id, cmd.length() > 3))
+                return;
+            AdptSendReply("NO DATA");
+            return;
+        }
+    }
+    AdptSendReply(sts ? OkMessage : ErrMessage);
+}
+
+/**
+ * The periodic frames, "AT#TA<period><id><data>" adds the frame with 
+ * the period in ms and 3 or 8 hex digits ID, "AT#TS<slot>" starts sending,
+ * "AT#TP<slot>" stops, "AT#TD<slot>" deletes, "AT#TC" clears and "AT#TL" lists
+ * with the jitter
+ * @param[in] cmd Command line
+ * @param[in] par The number in dispatch table
+ */
+static void OnPeriodicTx(const string_view& cmd, int par)
+{
+    CanTxScheduler* scheduler = CanTxScheduler::instance();
+    bool sts = true;
+    
+    switch (par) {
+        case PAR_TX_ADD: {
+            int idLen = (cmd.length() % 2) ? 3 : 8;
+            uint32_t period = 0, id = 0;
+            uint8_t data[8];
+            int len = to_bytes(cmd.substr(4 + idLen), data);
+            int slot = -1;
+            if (ToHexValue(cmd.substr(0, 4), period) && ToHexValue(cmd.substr(4, idLen), id) && 
+                len && len <= 8 && id <= (idLen == 3 ? 0x7FF : 0x1FFFFFFF)) {
+                CanMsgBuffer frame(id, idLen == 8, len, 0);
+                memcpy(frame.data, data, len);
+                slot = scheduler->add(period, frame);
+            }
+            if (slot >= 0) {
+                char out[4];
+                sprintf(out, "%X", slot);
+                AdptSendReply(out);
+                return;
+            }
+            sts = false;
+            break;
+        }
+        case PAR_TX_DELETE:
+            sts = scheduler->remove(to_digit(cmd[0]));
+            break;
+        case PAR_TX_CLEAR:
+            scheduler->clear();
+            break;
+        case PAR_TX_LIST:
+            scheduler->list();
+            return;
+        case PAR_TX_START:
+            sts = scheduler->start(to_digit(cmd[0]));
+            break;
+        case PAR_TX_STOP:
+            sts = scheduler->stop(to_digit(cmd[0]));
+            break;
+    }
+    AdptSendReply(sts ? OkMessage : ErrMessage);
+}
+
+/**
+ * Report the heap allocation counters and reset them, "AT#MEM"
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnBufferDump(const string& cmd, int par)
+static void OnAllocStats(const string_view& cmd, int par)
 {
-    OBDProfile::instance()->dumpBuffer();    
+    const AllocStats& last = AllocTracker::lastCommand();
+    const AllocStats& total = AllocTracker::total();
+    char out[60];
+    
+    sprintf(out, "LAST %u ALLOCS %u BYTES PEAK %u", last.allocs, last.bytes, last.peak);
+    AdptSendReply(out);
+    sprintf(out, "TOTAL %u ALLOCS %u BYTES PEAK %u USED %u", total.allocs, total.bytes, total.peak, total.inUse);
+    AdptSendReply(out);
+    AllocTracker::reset();
 }
 
 /**
@@ -184,6 +553,11 @@ static void SetDefault()
     config->setBoolProperty(PAR_ECHO, true);
     config->setBoolProperty(PAR_SPACES, true);
     config->setIntProperty(PAR_TIMEOUT, 0);
+    config->setIntProperty(PAR_CAN_CP, 0x18);
+    config->setIntProperty(PAR_WAKEUP_VAL, 0);
+    ByteArray none;
+    config->setBytesProperty(PAR_WM_HEADER, &none);
+    CanTxScheduler::instance()->clear();
     AdptSendReply(OkMessage);
 }
 
@@ -192,7 +566,7 @@ static void SetDefault()
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnSetDefault(const string& cmd, int par) 
+static void OnSetDefault(const string_view& cmd, int par) 
 {
     SetDefault();
     AdptSendReply(OkMessage);
@@ -203,7 +577,7 @@ static void OnSetDefault(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnProtocolDescribe(const string& cmd, int par)
+static void OnProtocolDescribe(const string_view& cmd, int par)
 {    
     OBDProfile::instance()->getProtocolDescription(); 
 }
@@ -213,12 +587,12 @@ static void OnProtocolDescribe(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnProtocolDescribeNum(const string& cmd, int par)
+static void OnProtocolDescribeNum(const string_view& cmd, int par)
 {
     OBDProfile::instance()->getProtocolDescriptionNum(); 
 }
 
-static void OnJ1939Monitor(const string& cmd, int par)
+static void OnJ1939Monitor(const string_view& cmd, int par)
 {
 	return;
 }
@@ -228,7 +602,7 @@ static void OnJ1939Monitor(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnProtocolClose(const string& cmd, int par) 
+static void OnProtocolClose(const string_view& cmd, int par) 
 {
     OBDProfile::instance()->closeProtocol();
 }
@@ -238,7 +612,7 @@ static void OnProtocolClose(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param]in] par The number in dispatch table, ignored
  */
-static void OnReadVoltage(const string& cmd, int par) 
+static void OnReadVoltage(const string_view& cmd, int par) 
 {
     const uint32_t actualVoltage = 1212;
     const uint32_t adcDivdr = 0x0A3D;
@@ -260,7 +634,7 @@ static void OnReadVoltage(const string& cmd, int par)
  * @param[in] cmd Command line
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnSetProtocol(const string& cmd, int par)
+static void OnSetProtocol(const string_view& cmd, int par)
 {
     bool useAutoSP = false;
     uint8_t protocol = 0;
@@ -292,7 +666,7 @@ static void OnSetProtocol(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnSendReplyInterface(const string& cmd, int par)
+static void OnSendReplyInterface(const string_view& cmd, int par)
 {
     AdptSendReply(Interface);
 }
@@ -302,13 +676,13 @@ static void OnSendReplyInterface(const string& cmd, int par)
  * @param[in] cmd Command line, ignored
  * @param[in] par The number in dispatch table, ignored
  */
-static void OnReset(const string& cmd, int par) 
+static void OnReset(const string_view& cmd, int par) 
 {
     SetDefault();
     AdptSendReply(Interface);
 }
 
-typedef void (*ParCallbackT)(const string& cmd, int par);
+typedef void (*ParCallbackT)(const string_view& cmd, int par);
 
 struct DispatchType {
     const char* name;
@@ -321,31 +695,66 @@ struct DispatchType {
 static const DispatchType dispatchTbl[] = {
     { "#1",   PAR_CHIP_COPYRIGHT,    0, 0, OnSendReplyCopyright   },
     { "#3",   PAR_WIRING_TEST,       0, 0, OnWiringTest           },
+    { "#AA",  PAR_AGGR_ADD,         11,11, OnAggregate            },
+    { "#AA",  PAR_AGGR_ADD,         16,16, OnAggregate            },
+    { "#AC",  PAR_AGGR_CLEAR,        0, 0, OnAggregate            },
+    { "#AD",  PAR_AGGR_DELETE,       1, 1, OnAggregate            },
+    { "#AS",  PAR_AGGR_START,        0, 0, OnAggregate            },
+    { "#LC",  PAR_LOAD_CEILING,      0, 0, OnResetValueInt        },
+    { "#LC",  PAR_LOAD_CEILING,      2, 2, OnSetValueInt          },
+    { "#MEM", PAR_ALLOC_STATS,       0, 0, OnAllocStats           },
+    { "#PA",  PAR_POLL_ADD,          6,18, OnPoll                 },
+    { "#PB",  PAR_POLL_DEADBAND,     2, 9, OnPoll                 },
+    { "#PC",  PAR_POLL_CLEAR,        0, 0, OnPoll                 },
+    { "#PD",  PAR_POLL_DELETE,       1, 1, OnPoll                 },
+    { "#PH",  PAR_POLL_HEARTBEAT,    1, 4, OnPoll                 },
+    { "#PL",  PAR_POLL_LIST,         0, 0, OnPoll                 },
+    { "#PO",  PAR_POLL_ON_CHANGE,    1, 1, OnPoll                 },
+    { "#PS",  PAR_POLL_START,        0, 0, OnPoll                 },
     { "#RSN", PAR_GET_SERIAL,        0, 0, OnGetSerial            },
+    { "#SC",  PAR_SNAPSHOT_CLEAR,    0, 0, OnSnapshot             },
+    { "#SD",  PAR_SNAPSHOT_DUMP,     0, 0, OnSnapshot             },
+    { "#SD",  PAR_SNAPSHOT_DUMP,     3, 3, OnSnapshot             },
+    { "#SD",  PAR_SNAPSHOT_DUMP,     8, 8, OnSnapshot             },
+    { "#SN",  PAR_SNAPSHOT_ON,       1, 1, OnSnapshot             },
+    { "#SS",  PAR_SNAPSHOT_CENSUS,   0, 0, OnSnapshot             },
+    { "#TA",  PAR_TX_ADD,            9,28, OnPeriodicTx           },
+    { "#TC",  PAR_TX_CLEAR,          0, 0, OnPeriodicTx           },
+    { "#TD",  PAR_TX_DELETE,         1, 1, OnPeriodicTx           },
+    { "#TL",  PAR_TX_LIST,           0, 0, OnPeriodicTx           },
+    { "#TP",  PAR_TX_STOP,           1, 1, OnPeriodicTx           },
+    { "#TS",  PAR_TX_START,          1, 1, OnPeriodicTx           },
     { "@1",   PAR_VERSION,           0, 0, OnSendReplyVersion     },
     { "AT0",  PAR_ADPTV_TIM0,        0, 0, OnSetOK                },
-	{ "AT1",  PAR_ADPTV_TIM1,        0, 0, OnSetOK                },
-	{ "AT2",  PAR_ADPTV_TIM2,        0, 0, OnSetOK                },
+    { "AT1",  PAR_ADPTV_TIM1,        0, 0, OnSetOK                },
+    { "AT2",  PAR_ADPTV_TIM2,        0, 0, OnSetOK                },
     { "BD",   PAR_BUFFER_DUMP,       0, 0, OnBufferDump           },
-	{ "BRD",  PAR_TRY_BRD,           2, 2, OnSetValueInt          },
-	{ "BRT",  PAR_SET_BRD,           2, 2, OnSetValueInt          },    
+    { "BDI",  PAR_BUFFER_DUMP_ID,    3, 3, OnBufferDump           },
+    { "BDI",  PAR_BUFFER_DUMP_ID,    6, 6, OnBufferDump           },
+    { "BDI",  PAR_BUFFER_DUMP_ID,    8, 8, OnBufferDump           },
+    { "BDI",  PAR_BUFFER_DUMP_ID,   16,16, OnBufferDump           },
+    { "BDL",  PAR_BUFFER_DUMP_LAST,  1, 2, OnBufferDump           },
+    { "BDR",  PAR_BUFFER_DUMP_RX,    0, 0, OnBufferDump           },
+    { "BDS",  PAR_BUFFER_DUMP_TX,    0, 0, OnBufferDump           },
+    { "BRD",  PAR_TRY_BRD,           2, 2, OnSetValueInt          },
+    { "BRT",  PAR_SET_BRD,           2, 2, OnSetValueInt          },
     { "CAF0", PAR_CAN_CAF,           0, 0, OnSetValueFalse        },
     { "CAF1", PAR_CAN_CAF,           0, 0, OnSetValueTrue         },
+    { "CEA",  PAR_CAN_EXT,           0, 0, OnResetValueInt        },
+    { "CEA",  PAR_CAN_EXT,           2, 2, OnSetValueInt          },
     { "CF",   PAR_CAN_CF,            3, 3, OnSetValueInt          },
     { "CF",   PAR_CAN_CF,            8, 8, OnSetValueInt          },
-   	{ "CEA",  PAR_CAN_EXT,           0, 0, OnResetValueInt        },
-	{ "CEA",  PAR_CAN_EXT,           2, 2, OnSetValueInt          },    
     { "CFC0", PAR_CAN_FLOW_CONTROL,  0, 0, OnSetValueFalse        },
-	{ "CFC1", PAR_CAN_FLOW_CONTROL,  0, 0, OnSetValueTrue         },    
+    { "CFC1", PAR_CAN_FLOW_CONTROL,  0, 0, OnSetValueTrue         },
     { "CM",   PAR_CAN_CM,            3, 3, OnSetValueInt          },
     { "CM",   PAR_CAN_CM,            8, 8, OnSetValueInt          },
     { "CP",   PAR_CAN_CP,            2, 2, OnSetValueInt          },
-   	{ "CRA",  PAR_CAN_SET_ADDRESS,   0, 0, OnResetValueInt        },
-	{ "CRA",  PAR_CAN_SET_ADDRESS,   3, 3, OnSetValueInt          },
-	{ "CRA",  PAR_CAN_SET_ADDRESS,   8, 8, OnSetValueInt          },
-	{ "CS",   PAR_CAN_SHOW_STATUS,   0, 0, OnCanShowStatus        },
-	{ "CSM0", PAR_CAN_MONITORING,    0, 0, OnSetValueFalse        },
-	{ "CSM1", PAR_CAN_MONITORING,    0, 0, OnSetValueTrue         },
+    { "CRA",  PAR_CAN_SET_ADDRESS,   0, 0, OnResetValueInt        },
+    { "CRA",  PAR_CAN_SET_ADDRESS,   3, 3, OnSetValueInt          },
+    { "CRA",  PAR_CAN_SET_ADDRESS,   8, 8, OnSetValueInt          },
+    { "CS",   PAR_CAN_SHOW_STATUS,   0, 0, OnCanShowStatus        },
+    { "CSM0", PAR_CAN_MONITORING,    0, 0, OnSetValueFalse        },
+    { "CSM1", PAR_CAN_MONITORING,    0, 0, OnSetValueTrue         },
     { "CV",   PAR_CALIBRATE_VOLT,    4, 4, OnSetOK                },
     { "D",    PAR_SET_DEFAULT,       0, 0, OnSetDefault           },
     { "D0",   PAR_CAN_DLC,           0, 0, OnSetValueFalse        },
@@ -355,29 +764,29 @@ static const DispatchType dispatchTbl[] = {
     { "DPN",  PAR_DESCRIBE_PROTCL_N, 0, 0, OnProtocolDescribeNum  },
     { "E0",   PAR_ECHO,              0, 0, OnSetValueFalse        },
     { "E1",   PAR_ECHO,              0, 0, OnSetValueTrue         },
-    { "FCSD", PAR_CAN_FLOW_CTRL_DAT, 1, 5, OnSetBytes             },    
-	{ "FCSH", PAR_CAN_FLOW_CTRL_HDR, 3, 3, OnSetValueInt          },
-	{ "FCSH", PAR_CAN_FLOW_CTRL_HDR, 8, 8, OnSetValueInt          },
-    { "FCSM", PAR_CAN_FLOW_CONTROL,  1, 1, OnSetValueInt          },    
+    { "FCSD", PAR_CAN_FLOW_CTRL_DAT, 1, 5, OnSetBytes             },
+    { "FCSH", PAR_CAN_FLOW_CTRL_HDR, 3, 3, OnSetValueInt          },
+    { "FCSH", PAR_CAN_FLOW_CTRL_HDR, 8, 8, OnSetValueInt          },
+    { "FCSM", PAR_CAN_FLOW_CONTROL,  1, 1, OnSetValueInt          },
     { "H0",   PAR_HEADER_SHOW,       0, 0, OnSetValueFalse        },
     { "H1",   PAR_HEADER_SHOW,       0, 0, OnSetValueTrue         },
     { "I",    PAR_INFO,              0, 0, OnSendReplyInterface   },
-	{ "JE",   PAR_J1939_FMT,         0, 0, OnSetValueTrue         },
-	{ "JHF0", PAR_J1939_HEADER,      0, 0, OnSetValueFalse        },
-	{ "JHF1", PAR_J1939_HEADER,      0, 0, OnSetValueTrue         },
-	{ "JS",   PAR_J1939_FMT,         0, 0, OnSetValueFalse        },
-	{ "JTM1", PAR_J1939_MLTPR5,      0, 0, OnSetValueFalse        },
-	{ "JTM5", PAR_J1939_MLTPR5,      0, 0, OnSetValueTrue         },   
+    { "JE",   PAR_J1939_FMT,         0, 0, OnSetValueTrue         },
+    { "JHF0", PAR_J1939_HEADER,      0, 0, OnSetValueFalse        },
+    { "JHF1", PAR_J1939_HEADER,      0, 0, OnSetValueTrue         },
+    { "JS",   PAR_J1939_FMT,         0, 0, OnSetValueFalse        },
+    { "JTM1", PAR_J1939_MLTPR5,      0, 0, OnSetValueFalse        },
+    { "JTM5", PAR_J1939_MLTPR5,      0, 0, OnSetValueTrue         },
     { "L0",   PAR_LINEFEED,          0, 0, OnSetValueFalse        },
-    { "LP",   PAR_LOW_POWER_MODE,    0, 0, OnSetOK                },
     { "L1",   PAR_LINEFEED,          0, 0, OnSetValueTrue         },
+    { "LP",   PAR_LOW_POWER_MODE,    0, 0, OnSetOK                },
     { "M0",   PAR_MEMORY,            0, 0, OnSetValueFalse        },
     { "M1",   PAR_MEMORY,            0, 0, OnSetValueTrue         },
     { "MP",   PAR_J1939_MONITOR,     4, 7, OnJ1939Monitor         },
     { "PC",   PAR_PROTOCOL_CLOSE,    0, 0, OnProtocolClose        },
-	{ "R0",   PAR_RESPONSES,         0, 0, OnSetValueFalse        },
-	{ "R1",   PAR_RESPONSES,         0, 0, OnSetValueTrue         },  
-    { "RTR",  PAR_CAN_SEND_RTR,      0, 0, OnSetOK                },    
+    { "R0",   PAR_RESPONSES,         0, 0, OnSetValueFalse        },
+    { "R1",   PAR_RESPONSES,         0, 0, OnSetValueTrue         },
+    { "RTR",  PAR_CAN_SEND_RTR,      0, 0, OnSetOK                },
     { "RV",   PAR_READ_VOLT,         0, 0, OnReadVoltage          },
     { "S0",   PAR_SPACES,            0, 0, OnSetValueFalse        },
     { "S1",   PAR_SPACES,            0, 0, OnSetValueTrue         },
@@ -386,106 +795,233 @@ static const DispatchType dispatchTbl[] = {
     { "SP",   PAR_PROTOCOL,          1, 2, OnSetProtocol          },
     { "ST",   PAR_TIMEOUT,           2, 2, OnSetValueInt          },
     { "SW",   PAR_WAKEUP_VAL,        2, 2, OnSetValueInt          },
-   	{ "TA",   PAR_TESTER_ADDRESS,    2, 2, OnSetValueInt          },
+    { "TA",   PAR_TESTER_ADDRESS,    2, 2, OnSetValueInt          },
     { "TP",   PAR_TRY_PROTOCOL,      1, 1, OnSetProtocol          },
-	{ "TP",   PAR_TRY_PROTOCOL,      2, 2, OnSetProtocol          },
+    { "TP",   PAR_TRY_PROTOCOL,      2, 2, OnSetProtocol          },
+    { "TR",   PAR_TRIGGER_STATUS,    0, 0, OnTrigger              },
+    { "TR0",  PAR_TRIGGER_OFF,       0, 0, OnTrigger              },
+    { "TRD",  PAR_TRIGGER_DATA,      4,32, OnTrigger              },
+    { "TRE",  PAR_TRIGGER_BUS_ERROR, 0, 0, OnTrigger              },
+    { "TRI",  PAR_TRIGGER_ID,        3, 3, OnTrigger              },
+    { "TRI",  PAR_TRIGGER_ID,        8, 8, OnTrigger              },
+    { "TRN",  PAR_TRIGGER_NEGATIVE,  0, 0, OnTrigger              },
+    { "TRP",  PAR_TRIGGER_POST,      1, 2, OnTrigger              },
+    { "TRT",  PAR_TRIGGER_TIMEOUT,   0, 0, OnTrigger              },
     { "V0",   PAR_CAN_VAIDATE_DLC,   0, 0, OnSetValueFalse        },
     { "V1",   PAR_CAN_VAIDATE_DLC,   0, 0, OnSetValueTrue         },
-    { "WM",   PAR_WM_HEADER,         1, 6, OnSetBytes             },
+    { "WM",   PAR_WM_HEADER,         2,12, OnSetBytes             },
     { "WS",   PAR_WARMSTART,         0, 0, OnReset                },
     { "Z",    PAR_RESET_CPU,         0, 0, OnReset                }
 };
 
-static bool ValidateArgLength(const DispatchType& entry, const string& arg)
+const int DispatchTblLen = sizeof(dispatchTbl) / sizeof(dispatchTbl[0]);
+
+#ifdef DISPATCH_VALIDATE
+/**
+ * Validate the dispatch table is sorted and has no ambiguous entries, aborts otherwise
+ */
+static void ValidateDispatchTable()
+{
+    for (int i = 1; i < DispatchTblLen; i++) {
+        const DispatchType& prev = dispatchTbl[i - 1];
+        const DispatchType& next = dispatchTbl[i];
+        int cmp = strcmp(prev.name, next.name);
+        if (cmp > 0) {
+            abort(); // Not sorted
+        }
+        if (cmp == 0 && next.minParNum <= prev.maxParNum) {
+            abort(); // Duplicate or overlapping argument length
+        }
+    }
+}
+#endif
+
+/**
+ * Find the first table entry starting with the character, the table is sorted
+ * @param[in] ch The first command character
+ * @return The table index
+ */
+static int FindFirstEntry(char ch)
 {
-    int len = arg.length();
-    return len >= entry.minParNum && len <= entry.maxParNum;
+    int lo = 0;
+    int hi = DispatchTblLen;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (dispatchTbl[mid].name[0] < ch) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
 }
 
 /**
- * Dispatch the AT command to the proper handler with particular type
- * @param[in] cmdString Command line
- * @return true if command was dispatched, false otherwise
+ * Find the AT command handler in one pass over the entries with the same first character.
+ * The exact match for command without arguments wins, otherwise the longest
+ * name prefix with the valid argument length.
+ * @param[in] atcmd The command without "AT" chars
+ * @return The dispatch table entry, nullptr if not found
  */
-static bool DispatchATCmd(const string& cmdString, int numOfChar, int type)
+static const DispatchType* FindATCmd(const string_view& atcmd)
 {
-     // Ignore first two "AT" chars
-    string atcmd = (type == 0) ? cmdString.substr(2) : cmdString.substr(2, numOfChar); 
+    const DispatchType* found = nullptr;
+    int foundLen = 0;
 
-    for (int i = 0; i < sizeof(dispatchTbl)/sizeof(dispatchTbl[0]); i++) {
-        int cmdType = (dispatchTbl[i].minParNum > 0) ? 1 : 0;
+    if (atcmd.empty())
+        return nullptr;
+    
+    for (int i = FindFirstEntry(atcmd[0]); i < DispatchTblLen; i++) {
+        const DispatchType& entry = dispatchTbl[i];
+        if (entry.name[0] != atcmd[0])
+            break;
         
-        if ((cmdType == type) && (atcmd == dispatchTbl[i].name)) {
-            string arg = (type == 1) ? cmdString.substr(numOfChar + 2) : "";
-            
-            // Argument length validation if we have argument
-            if (type && !ValidateArgLength(dispatchTbl[i], arg)) {
-                continue;
-            }
-            
-            // Have callback?
-            if (!dispatchTbl[i].callback)
-                return false;
-            
-            dispatchTbl[i].callback(arg, dispatchTbl[i].id);
-            return true;
+        if (!atcmd.starts_with(entry.name))
+            continue;
+        
+        int nameLen = strlen(entry.name);
+        int argLen = atcmd.length() - nameLen;
+        if (entry.minParNum == 0) {
+            if (argLen == 0)
+                return &entry; // Exact match
+        }
+        else if (argLen >= entry.minParNum && argLen <= entry.maxParNum && nameLen > foundLen) {
+            found = &entry;
+            foundLen = nameLen;
         }
     }
-    return false;
+    return found;
 }
 
 /**
- * Parse and dispatch AT sequence
+ * Parse and dispatch AT sequence, the handler gets the argument
+ * as a view into the command buffer
  * @param[in] cmdString The user command 
  * @return true if command was parsed, false otherwise
  */
-static bool ParseGenericATCmd(const string& cmdString)
+static bool ParseGenericATCmd(const string_view& cmdString)
 {
-    bool dispatched = DispatchATCmd(cmdString, 4, 0); // Do exact string match, like "AT#DP" 
-    if (dispatched)
-        return true;
-    dispatched = DispatchATCmd(cmdString, 3, 1); // Three char sequence prefixes
-    if (dispatched)
-        return true;
-    return DispatchATCmd(cmdString, 2, 1); // Two char sequence prefixes
+    // Ignore first two "AT" chars
+    string_view atcmd = cmdString.substr(2);
+    const DispatchType* entry = FindATCmd(atcmd);
+    
+    // Have callback?
+    if (!entry || !entry->callback)
+        return false;
+    
+    entry->callback(atcmd.substr(strlen(entry->name)), entry->id);
+    return true;
 }
 
 /**
  * Get the new command, do the processing. The "entry point" is here!
- * @param[in] cmdString The user command
+ * @param[in] cmd The user command, parsed already
  */
-void AdptOnCmd(string& cmdString)
+void AdptOnCmd(const CmdLexer& cmd)
 {
-    static string PreviousCmd(USER_BUF_LEN);
+    static CmdLexer PreviousCmd;
     bool succeeded = false;
     
-    // Compress and convert to uppercase 
-    to_upper(cmdString);
-    remove_space(cmdString);
-
-    // Repeat the previous ?
-    if (cmdString.empty()) {
-        cmdString = PreviousCmd;
-    }
-    else {
-        PreviousCmd = cmdString;
+    AllocTracker::beginCommand();
+    
+    // Repeat the previous, empty or the same command?
+    bool repeat = cmd.empty() || (cmd.command() == PreviousCmd.command());
+    if (!repeat) {
+        PreviousCmd = cmd;
     }
 
-    // Do we have AT sequence here?
-    if (cmdString.substr(0,2) != "AT") { // Not AT sequence
-        if (is_xdigits(cmdString)) {     // Should be only digits
-            OBDProfile::instance()->onRequest(cmdString);
+    switch (PreviousCmd.type()) {
+        case CmdLexer::CMD_HEX: // Should be only digits
+            OBDProfile::instance()->onRequest(PreviousCmd.bytes(), PreviousCmd.length(), repeat);
+#ifdef ALLOC_CHECK
+            if (repeat && AllocTracker::command().allocs) {
+                abort(); // The steady state request should not use heap
+            }
+#endif
             succeeded = true;
-        }
-    }
-    else { // AT sequence
-        succeeded = ParseGenericATCmd(cmdString); // String cmd->numeric
+            break;
+        case CmdLexer::CMD_AT:
+            succeeded = ParseGenericATCmd(PreviousCmd.command()); // String cmd->numeric
+            break;
     }
     
     if (!succeeded) {
         AdptSendReply(ErrMessage);
     }
-    AdptSendString(">");
+    // The polling replies follow, the prompt is sent when it stops
+    if (!AdptIsPolling()) {
+        AdptSendString(">");
+    }
+}
+
+/**
+ * Check if the adapter is polling the requests or aggregating, see "AT#PS", "AT#AS"
+ * @return true if polling, false otherwise
+ */
+bool AdptIsPolling()
+{
+    return PidScheduler::instance()->running() || CanAggregator::instance()->running();
+}
+
+/**
+ * Send the polled request if due and the aggregation summaries, called 
+ * from the main loop. Any character received stops polling, then
+ * "STOPPED" and the prompt are sent.
+ */
+void AdptOnPoll()
+{
+    PidScheduler* scheduler = PidScheduler::instance();
+    CanAggregator* aggregator = CanAggregator::instance();
+    
+    CanBusMeter::instance()->step();
+    if (!AdptIsAborted() && aggregator->running()) {
+        aggregator->step();
+    }
+    if (!AdptIsAborted() && scheduler->running()) {
+        scheduler->step();
+    }
+    if (AdptIsAborted()) {
+        scheduler->stop();
+        aggregator->stop();
+        AdptSendReply(StopMessage);
+        AdptSendString(">");
+    }
+}
+
+/**
+ * Process the bus frames between commands and send the wakeup message,
+ * called from the main loop if the adapter is not busy
+ */
+void AdptOnIdle()
+{
+    CanMonitor* monitor = CanMonitor::instance();
+    if (monitor->snapshot()) {
+        monitor->drain();
+    }
+    else {
+        monitor->checkErrors();
+    }
+    CanBusMeter::instance()->step();
+    OBDProfile::instance()->onIdle();
+}
+
+/**
+ * Set the prefix for the reply lines, used to tag the polled request replies
+ * @param[in] tag The prefix string, must stay valid till reset
+ */
+void AdptSetReplyTag(const char* tag)
+{
+    ReplyTag = tag;
+}
+
+/**
+ * Get the reply lines prefix
+ * @return The prefix string, empty if not tagged
+ */
+const char* AdptGetReplyTag()
+{
+    return ReplyTag;
 }
 
 /**
@@ -493,7 +1029,10 @@ void AdptOnCmd(string& cmdString)
  */
 void AdptDispatcherInit() 
 {
-    OnReset("", PAR_RESET_CPU);
+#ifdef DISPATCH_VALIDATE
+    ValidateDispatchTable();
+#endif
+    OnReset(string_view(), PAR_RESET_CPU);
     AdptSendString(">");
 }
 
@@ -503,7 +1042,17 @@ void AdptDispatcherInit()
  */
 void AdptSendReply(const string& str)
 {
-    string s = str;
+    AdptSendReply(str.c_str());
+}
+
+/**
+ * Send out string constant with <CR><LF>
+ * @param[in] str String to send
+ */
+void AdptSendReply(const char* str)
+{
+    fixed_string<TX_BUFFER_LEN> s = ReplyTag;
+    s += str;
     if (AdapterConfig::instance()->getBoolProperty(PAR_LINEFEED)) {
         s += "\r\n";
         AdptSendString(s);
@@ -105,20 +105,19 @@ void KWordsToString(const uint8_t* kw, string& str)
  * @param[out] bytes The result as sequence of bytes
  * @return The length of output
  **/
-uint32_t to_bytes(const string& str, uint8_t* bytes)
+uint32_t to_bytes(const string_view& str, uint8_t* bytes)
 {
     int len = str.length();
     
     if ((len % 2) != 0)
         return 0;
     
-    int j = 0;
     for (int i = 0; i < len / 2; i++) {
-        uint32_t hexValue = stoul(str.substr(j, 2), 0, 16);
-        if (hexValue == ULONG_MAX)
+        int hi = to_digit(str[i * 2]);
+        int lo = to_digit(str[i * 2 + 1]);
+        if (hi < 0 || lo < 0)
             return 0;
-        bytes[i] = hexValue;
-        j += 2;
+        bytes[i] = (hi << 4) | lo;
     }
     return len / 2;
 }
@@ -134,8 +133,7 @@ void to_ascii(const uint8_t* bytes, uint32_t length, string& str)
 {
     bool useSpaces = AdapterConfig::instance()->getBoolProperty(PAR_SPACES);
     for (int i = 0; i < length; i++) {
-        str += to_ascii(bytes[i] >> 4);
-        str += to_ascii(bytes[i] & 0x0F);
+        str.append(hex_table[bytes[i]], 2);
         if (useSpaces) {
             str += ' ';
         }
@@ -28,7 +28,7 @@ int AutoAdapter::onConnectEcu(bool sendReply)
     int protocol = 0;
     // CAN
     protocol = ProtocolAdapter::getAdapter(ADPTR_CAN)->onConnectEcu(sendReply);
-    if (protocol != 0)
+    if (protocol != 0 || AdptIsAborted())
         return protocol;
     // CAN 29
     protocol = ProtocolAdapter::getAdapter(ADPTR_CAN_EXT)->onConnectEcu(sendReply);
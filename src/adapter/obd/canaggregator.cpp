@@ -0,0 +1,199 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include <cstdio>
+#include <Timer.h>
+#include <CanDriver.h>
+#include "canaggregator.h"
+#include "canmonitor.h"
+
+using namespace util;
+
+/**
+ * CanAggregator singleton
+ * @return The CanAggregator class instance
+ */
+CanAggregator* CanAggregator::instance()
+{
+    static CanAggregator instance;
+    return &instance;
+}
+
+/**
+ * Construct CanAggregator object, no slots
+ */
+CanAggregator::CanAggregator() : running_(false)
+{
+    memset(slots_, 0, sizeof(slots_));
+}
+
+/**
+ * Configure the first free slot
+ * @param[in] id The CAN ID, 7FF or 1FFFFFFF max
+ * @param[in] extended CAN 29 bit flag
+ * @param[in] pos The field first bit, 0 is the byte 0 MSB
+ * @param[in] bits The field length, 1..32
+ * @param[in] window The window length, ms
+ * @return The slot number, -1 if no free slots or parameters are invalid
+ */
+int CanAggregator::add(uint32_t id, bool extended, int pos, int bits, uint32_t window)
+{
+    if (bits < 1 || bits > 32 || (pos + bits) > 64 || window == 0 || window > MAX_WINDOW)
+        return -1;
+    if (id > (extended ? 0x1FFFFFFF : 0x7FF))
+        return -1; // The filter would drop the high bits
+
+    for (int i = 0; i < SLOTS_LEN; i++) {
+        AggregateSlot& slot = slots_[i];
+        if (slot.bits)
+            continue;
+        slot.id = id;
+        slot.extended = extended;
+        slot.pos = pos;
+        slot.bits = bits;
+        slot.window = window;
+        if (running_) {
+            slot.start = Clock::now();
+            slot.count = 0;
+            CanDriver::instance()->setFilterAndMask(id, extended ? 0x1FFFFFFF : 0x7FF, extended, i + 1);
+        }
+        return i;
+    }
+    return -1;
+}
+
+/**
+ * Free the slot
+ * @param[in] slot The slot number
+ * @return true if the slot was used, false otherwise
+ */
+bool CanAggregator::remove(int slot)
+{
+    if (slot < 0 || slot >= SLOTS_LEN || !slots_[slot].bits)
+        return false;
+
+    slots_[slot].bits = 0;
+    CanDriver::instance()->clearFilter(slot + 1);
+    return true;
+}
+
+/**
+ * Free all slots and stop
+ */
+void CanAggregator::clear()
+{
+    stop();
+    memset(slots_, 0, sizeof(slots_));
+}
+
+/**
+ * Open the slot filters and start the windows
+ * @return true if started, false if there are no slots
+ */
+bool CanAggregator::start()
+{
+    CanDriver* driver = CanDriver::instance();
+    uint16_t now = Clock::now();
+
+    for (int i = 0; i < SLOTS_LEN; i++) {
+        AggregateSlot& slot = slots_[i];
+        if (!slot.bits)
+            continue;
+        slot.start = now;
+        slot.count = 0;
+        driver->setFilterAndMask(slot.id, slot.extended ? 0x1FFFFFFF : 0x7FF, slot.extended, i + 1);
+        running_ = true;
+    }
+    return running_;
+}
+
+/**
+ * Close the slot filters
+ */
+void CanAggregator::stop()
+{
+    for (int i = 0; running_ && i < SLOTS_LEN; i++) {
+        if (slots_[i].bits) {
+            CanDriver::instance()->clearFilter(i + 1);
+        }
+    }
+    running_ = false;
+}
+
+/**
+ * Add the frame field value to its slot statistics
+ * @param[in] msg The monitored ID frame
+ */
+void CanAggregator::update(const CanMsgBuffer* msg)
+{
+    int num = msg->msgnum - 1;
+    if (!running_ || num < 0 || num >= SLOTS_LEN)
+        return;
+
+    AggregateSlot& slot = slots_[num];
+    if (!slot.bits || (slot.pos + slot.bits) > (msg->dlc * 8))
+        return; // Too short
+
+    uint64_t data = 0;
+    for (int i = 0; i < 8; i++) {
+        data = (data << 8) | msg->data[i];
+    }
+    uint32_t mask = 0xFFFFFFFF >> (32 - slot.bits);
+    uint32_t val = static_cast<uint32_t>(data >> (64 - slot.pos - slot.bits)) & mask;
+
+    if (!slot.count || val < slot.min) {
+        slot.min = val;
+    }
+    if (!slot.count || val > slot.max) {
+        slot.max = val;
+    }
+    slot.sum = slot.count ? (slot.sum + val) : val;
+    if (slot.count < 0xFFFF) {
+        slot.count++;
+    }
+}
+
+/**
+ * Send the slot window summary
+ * @param[in] num The slot number
+ */
+void CanAggregator::sendSummary(int num)
+{
+    const AggregateSlot& slot = slots_[num];
+    char out[48];
+
+    if (slot.count) {
+        uint32_t mean = static_cast<uint32_t>(slot.sum / slot.count);
+        sprintf(out, "A%X:%04X %X %X %X", num, slot.count, slot.min, slot.max, mean);
+    }
+    else {
+        sprintf(out, "A%X:0000", num);
+    }
+    AdptSendReply(out);
+}
+
+/**
+ * Drain the received frames between requests and send the summaries
+ * for the completed windows, called from the main loop
+ */
+void CanAggregator::step()
+{
+    CanMonitor::instance()->drain();
+
+    uint16_t now = Clock::now();
+    for (int i = 0; i < SLOTS_LEN; i++) {
+        AggregateSlot& slot = slots_[i];
+        if (!slot.bits || static_cast<uint16_t>(now - slot.start) < slot.window)
+            continue;
+        sendSummary(i);
+        slot.count = 0;
+        slot.start += slot.window;
+        if (static_cast<uint16_t>(now - slot.start) >= slot.window) {
+            slot.start = now; // Far behind, restart
+        }
+    }
+}
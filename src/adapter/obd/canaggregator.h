@@ -0,0 +1,56 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#ifndef __CAN_AGGREGATOR_H__
+#define __CAN_AGGREGATOR_H__
+
+#include <adaptertypes.h>
+#include <canmsgbuffer.h>
+
+//
+// The monitored CAN ID signal statistics for one window
+//
+struct AggregateSlot {
+    uint32_t id;
+    uint8_t  extended;
+    uint8_t  pos;      // The field first bit, 0 is the byte 0 MSB
+    uint8_t  bits;     // The field length, 0 - free slot
+    uint16_t window;   // ms
+    uint16_t start;    // The window start time, Clock::now() based
+    uint16_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+};
+
+//
+// Aggregates the signal of the monitored CAN IDs, each slot has its own
+// CAN filter bank, so the frames are told by the filter match index.
+// The slots are updated as the frames are drained and one summary
+// record "A<slot>:<count> <min> <max> <mean>" is sent per window.
+//
+class CanAggregator {
+public:
+    static const uint32_t MAX_WINDOW = 0x7FFF; // The Clock::now() half range
+    static CanAggregator* instance();
+    int add(uint32_t id, bool extended, int pos, int bits, uint32_t window);
+    bool remove(int slot);
+    void clear();
+    bool start();
+    void stop();
+    bool running() const { return running_; }
+    void update(const CanMsgBuffer* msg);
+    void step();
+private:
+    CanAggregator();
+    void sendSummary(int slot);
+    const static int SLOTS_LEN = AGGREGATE_SLOTS_LEN;
+    AggregateSlot slots_[SLOTS_LEN];
+    bool          running_;
+};
+
+#endif //__CAN_AGGREGATOR_H__
@@ -0,0 +1,132 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <Timer.h>
+#include <CanDriver.h>
+#include "canbusmeter.h"
+
+const int SECOND = 1000; // ms
+
+/**
+ * CanBusMeter singleton
+ * @return The CanBusMeter class instance
+ */
+CanBusMeter* CanBusMeter::instance()
+{
+    static CanBusMeter instance;
+    return &instance;
+}
+
+/**
+ * Construct CanBusMeter object, open the count filter, the first second starts now
+ */
+CanBusMeter::CanBusMeter() : pos_(0), filled_(0)
+{
+    CanBusStatus status;
+    CanDriver::instance()->setCountFilter(COUNT_FILTER);
+    CanDriver::instance()->getStatus(&status);
+    rxCount_ = status.rxBits;
+    txCount_ = status.txBits;
+    start_ = Clock::now();
+    memset(busBits_, 0, sizeof(busBits_));
+    memset(txBits_, 0, sizeof(txBits_));
+}
+
+/**
+ * Close the completed seconds, called from the main loop. If late, 
+ * the bits are spread evenly over the missed seconds
+ */
+void CanBusMeter::step()
+{
+    uint16_t elapsed = Clock::now() - start_;
+    if (elapsed < SECOND)
+        return;
+
+    CanBusStatus status;
+    CanDriver::instance()->getStatus(&status);
+    uint32_t rx = status.rxBits - rxCount_;
+    uint32_t tx = status.txBits - txCount_;
+    rxCount_ = status.rxBits;
+    txCount_ = status.txBits;
+
+    int seconds = elapsed / SECOND;
+    start_ += seconds * SECOND;
+    for (int i = 0; i < seconds; i++) {
+        pos_ = (pos_ + 1) % WINDOW_LEN;
+        busBits_[pos_] = (rx + tx) / seconds;
+        txBits_[pos_] = tx / seconds;
+    }
+    filled_ = (filled_ + seconds) < WINDOW_LEN ? (filled_ + seconds) : WINDOW_LEN;
+}
+
+/**
+ * The bus load average over the last seconds
+ * @param[in] bits The per second bits
+ * @param[in] seconds The window length, 1..WINDOW_LEN
+ * @return The load, 1/1000 of the bit rate
+ */
+uint32_t CanBusMeter::average(const uint32_t* bits, int seconds) const
+{
+    seconds = (seconds < filled_) ? seconds : filled_;
+    if (!seconds)
+        return 0;
+    
+    uint32_t sum = 0;
+    for (int i = 0; i < seconds; i++) {
+        sum += bits[(pos_ + WINDOW_LEN - i) % WINDOW_LEN];
+    }
+    return sum / (CanDriver::bitRate() / 1000 * seconds);
+}
+
+/**
+ * The total bus load
+ * @param[in] seconds The window length, 1..WINDOW_LEN
+ * @return The load, 1/1000 of the bit rate
+ */
+uint32_t CanBusMeter::load(int seconds) const
+{
+    return average(busBits_, seconds);
+}
+
+/**
+ * The adapter transmit share of the bus load
+ * @param[in] seconds The window length, 1..WINDOW_LEN
+ * @return The load, 1/1000 of the bit rate
+ */
+uint32_t CanBusMeter::txLoad(int seconds) const
+{
+    return average(txBits_, seconds);
+}
+
+/**
+ * Display the error counters and the bus load, the first line
+ * is ELM327 compatible "T:<TEC> R:<REC>"
+ */
+void CanBusMeter::sendStatus() const
+{
+    CanBusStatus status;
+    char out[48];
+
+    CanDriver::instance()->getStatus(&status);
+    sprintf(out, "T:%02X R:%02X", status.tec, status.rec);
+    AdptSendReply(out);
+    sprintf(out, "LEC:%u BUS OFF:%u", status.lec, status.busOff);
+    AdptSendReply(out);
+    sprintf(out, "OVERFLOW RX:%u TX:%u", status.rxOverflow, status.txOverflow);
+    AdptSendReply(out);
+
+    uint32_t load1 = load(1);
+    uint32_t load10 = load(WINDOW_LEN);
+    sprintf(out, "LOAD 1S:%u.%u%% 10S:%u.%u%%", load1 / 10, load1 % 10, load10 / 10, load10 % 10);
+    AdptSendReply(out);
+    load1 = txLoad(1);
+    load10 = txLoad(WINDOW_LEN);
+    sprintf(out, "TX 1S:%u.%u%% 10S:%u.%u%%", load1 / 10, load1 % 10, load10 / 10, load10 % 10);
+    AdptSendReply(out);
+}
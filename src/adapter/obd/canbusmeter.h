@@ -0,0 +1,40 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#ifndef __CAN_BUS_METER_H__
+#define __CAN_BUS_METER_H__
+
+#include <adaptertypes.h>
+#include "canmonitor.h"
+
+//
+// The bus load over the last 1 and 10 seconds, from the driver frame bit
+// counters sampled once a second. The whole bus is counted, the frames
+// not matched by the other filters go to the count only catch-all filter.
+//
+class CanBusMeter {
+public:
+    const static int WINDOW_LEN = 10; // The long window, s
+    const static uint32_t COUNT_FILTER = CanMonitor::SNAPSHOT_FILTER + 1; // Catch all, the last bank
+    static CanBusMeter* instance();
+    void step();
+    uint32_t load(int seconds) const;
+    uint32_t txLoad(int seconds) const;
+    void sendStatus() const;
+private:
+    CanBusMeter();
+    uint32_t average(const uint32_t* bits, int seconds) const;
+    uint32_t busBits_[WINDOW_LEN]; // The last seconds, rx + tx
+    uint32_t txBits_[WINDOW_LEN];
+    uint32_t rxCount_;             // The driver counters at the second start
+    uint32_t txCount_;
+    uint16_t start_;               // The second start time, Clock::now() based
+    int      pos_;                 // The latest completed second
+    int      filled_;
+};
+
+#endif //__CAN_BUS_METER_H__
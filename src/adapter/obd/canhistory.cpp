@@ -5,7 +5,9 @@
  *
  */
 
+#include <cstdio>
 #include <cstring>
+#include <Timer.h>
 #include "canhistory.h"
 #include "canmsgbuffer.h"
 
@@ -13,70 +15,181 @@ using namespace std;
 using namespace util;
 
 /**
- * Display the message history
+ * CanHistory singleton, shared by CAN adapters
+ * @return The CanHistory class instance
  */
-void CanHistory::dumpCurrentBuffer()
+CanHistory* CanHistory::instance()
 {
-    const int can11Pos = 5;
-    const int can29Pos = 10;
-    int i, endp;
+    static CanHistory instance;
+    return &instance;
+}
+
+/**
+ * Check if the entry matches the dump filter
+ * @param[in] entry The history entry
+ * @param[in] filter The dump filter
+ * @return true if matches, false otherwise
+ */
+bool CanHistory::isSelected(const CanMsgBuffer& entry, const HistoryFilter& filter) const
+{
+    if (entry.id < filter.idFrom || entry.id > filter.idTo)
+        return false;
     
-    // Calculate the end of the buffer
-    if (numOfEntries_ <= HISTORY_LEN)
-        i = endp = 0;
-    else 
-        i = endp = currMsgPos_;
+    switch (filter.dir) {
+        case HistoryFilter::DIR_RX:
+            return !entry.dir;
+        case HistoryFilter::DIR_TX:
+            return entry.dir;
+    }
+    return true;
+}
+
+/**
+ * Display the message history, oldest first. The line has the 
+ * sequence number, timestamp in ms, CAN ID, direction, DLC, data
+ * and the filter match index.
+ * @param[in] filter The frames to display
+ */
+void CanHistory::dumpCurrentBuffer(const HistoryFilter& filter)
+{
+    const int prefixLen = 11;
+    const int can11Pos = prefixLen + 5;
+    const int can29Pos = prefixLen + 10;
+    
+    // Calculate the first entry to display
+    uint32_t count = (seq_ < HISTORY_LEN) ? seq_ : HISTORY_LEN;
+    if (filter.last && filter.last < count) {
+        count = filter.last;
+    }
+    const uint32_t first = seq_ - count;
     
     // Calculate the message ID length, 11bit or 29bit
     bool extended = false;
-    int pos1 = can11Pos; int j = i;
-    do {
-        if (msglog_[j].ext) { pos1 = can29Pos; extended = true; break; }
-        // Advance the position
-        j = (j == HISTORY_LEN-1) ? 0 : j + 1;        
-    } while (j != endp);
+    for (uint32_t s = first; s != seq_; s++) {
+        const CanMsgBuffer& entry = msglog_[s % HISTORY_LEN];
+        if (entry.extended && isSelected(entry, filter)) {
+            extended = true;
+            break;
+        }
+    }
 
+    const int pos1 = extended ? can29Pos : can11Pos;
     const int pos2 = pos1 + 3;
     const int pos3 = pos2 + 3;
-    string out;
+    fixed_string<REPLY_LEN> out;
+    char prefix[prefixLen + 1];
     
-    do {
-        out.resize(0);
-        CanIDToString(msglog_[i].id, out, extended);
+    for (uint32_t s = first; s != seq_; s++) {
+        const CanMsgBuffer& entry = msglog_[s % HISTORY_LEN];
+        if (!isSelected(entry, filter))
+            continue;
+        
+        sprintf(prefix, "%04X %5u ", s & 0xFFFF, static_cast<unsigned>(entry.time));
+        out = prefix;
+        CanIDToString(entry.id, out, extended);
         out.resize(pos1, ' ');
-        out += msglog_[i].dir ? 'S' : 'R';
+        out += entry.dir ? 'S' : 'R';
         out.resize(pos2, ' ');
-        out += msglog_[i].dlc + '0';
+        out += entry.dlc + '0';
         out.resize(pos3, ' ');
-        to_ascii(msglog_[i].data, 8, out);
+        to_ascii(entry.data, 8, out);
         out += "  -> ";
-        to_ascii(&msglog_[i].mid, 1, out);
+        to_ascii(&entry.msgnum, 1, out);
+        if (state_ >= TRIG_FIRED && s == trigSeq_) {
+            out += " *"; // The trigger frame
+        }
         
         AdptSendReply(out);
-        // Advance the position
-        i = (i == HISTORY_LEN-1) ? 0 : i + 1;
-    } while (i != endp);
+    }
 }
 
 /**
- * Add the CAN message to history log
+ * Add the CAN message to history log, the oldest entry is overwritten
  * @param[in] buff The CanMsgBuffer pointer to add
  * @param[in] dir The direction, false - receive, true send
  * @param[in] mid CAN receiver message buffer id
  */
 void CanHistory::add2Buffer(const CanMsgBuffer* buff, bool dir, uint8_t mid)
 {
-    int i = currMsgPos_++;
+    if (state_ == TRIG_FROZEN)
+        return;
+    
+    CanMsgBuffer& entry = msglog_[seq_ % HISTORY_LEN];
+    entry = *buff;
+    entry.dir = dir;
+    entry.msgnum = mid;
+    if (dir) { // The received frames have the ISR timestamp
+        entry.time = Clock::now();
+    }
+    
+    if (state_ == TRIG_ARMED && isTriggered(entry)) {
+        fire(seq_);
+    }
+    else if (state_ == TRIG_FIRED && --postLeft_ == 0) {
+        state_ = TRIG_FROZEN;
+    }
+    seq_++;
+}
 
-    msglog_[i].id = buff->id;
-    msglog_[i].dir = dir;
-    msglog_[i].ext = buff->extended;
-    msglog_[i].dlc = buff->dlc;
-    memcpy(msglog_[i].data, buff->data, sizeof(buff->data));
-    msglog_[i].mid = mid;
+/**
+ * Check the frame against the armed trigger
+ * @param[in] entry The history entry
+ * @return true if the frame meets the trigger condition
+ */
+bool CanHistory::isTriggered(const CanMsgBuffer& entry) const
+{
+    switch (trigger_.type) {
+        case HistoryTrigger::TRIG_ID:
+            return entry.id == trigger_.id;
+        case HistoryTrigger::TRIG_DATA:
+            for (int i = 0; i < 8; i++) {
+                if ((entry.data[i] & trigger_.mask[i]) != (trigger_.data[i] & trigger_.mask[i]))
+                    return false;
+            }
+            return true;
+        case HistoryTrigger::TRIG_NEGATIVE: // Received single frame 7F xx xx
+            return !entry.dir && (entry.data[0] & 0xF0) == 0 && entry.data[1] == 0x7F;
+    }
+    return false;
+}
+
+/**
+ * Start the post-trigger countdown
+ * @param[in] seq The trigger frame sequence number
+ */
+void CanHistory::fire(uint32_t seq)
+{
+    trigSeq_ = seq;
+    postLeft_ = trigger_.postFrames;
+    state_ = postLeft_ ? TRIG_FIRED : TRIG_FROZEN;
+}
+
+/**
+ * Arm the capture trigger, the frozen history is released
+ * @param[in] trigger The trigger condition
+ */
+void CanHistory::arm(const HistoryTrigger& trigger)
+{
+    trigger_ = trigger;
+    state_ = TRIG_ARMED;
+}
 
-    if (currMsgPos_ >= HISTORY_LEN) { // curMsgPos = [0...15]
-        currMsgPos_ = 0;
+/**
+ * Disarm the trigger and resume the recording
+ */
+void CanHistory::disarm()
+{
+    trigger_.type = HistoryTrigger::TRIG_NONE;
+    state_ = TRIG_OFF;
+}
+
+/**
+ * The bus error or timeout happened, fire the armed trigger
+ * @param[in] type The event, TRIG_BUS_ERROR or TRIG_TIMEOUT
+ */
+void CanHistory::onEvent(int type)
+{
+    if (state_ == TRIG_ARMED && trigger_.type == type) {
+        fire(seq_ - 1); // The last recorded frame
     }
-    numOfEntries_++;
 }
@@ -9,35 +9,64 @@
 #define __CAN_HISTORY_H__
 
 #include <adaptertypes.h>
+#include <canmsgbuffer.h>
 
 using namespace util;
 
-struct MsgEntry {
-	MsgEntry() : id(0), dir(false), ext(false), dlc(0), mid(0)
-	{
-		memset(data, 0, sizeof(data));
-	}
-    uint32_t id;
-    bool dir;
-    bool ext;
-    uint8_t dlc;
-    uint8_t mid;
-    uint8_t data[8];
+//
+// The frames selection for ATBD dump
+//
+struct HistoryFilter {
+    enum Direction { DIR_ANY, DIR_RX, DIR_TX };
+    HistoryFilter() : last(0), idFrom(0), idTo(0xFFFFFFFF), dir(DIR_ANY) {}
+    uint32_t last;   // The number of the latest frames, 0 - all
+    uint32_t idFrom; // CAN ID range
+    uint32_t idTo;
+    int      dir;
 };
 
-struct CanMsgBuffer;
+//
+// The capture trigger, the history is frozen the number
+// of frames after the trigger condition met
+//
+struct HistoryTrigger {
+    enum Type { TRIG_NONE, TRIG_ID, TRIG_DATA, TRIG_NEGATIVE, TRIG_BUS_ERROR, TRIG_TIMEOUT };
+    HistoryTrigger() : type(TRIG_NONE), id(0), postFrames(CAN_HISTORY_LEN / 2) {
+        memset(data, 0, sizeof(data));
+        memset(mask, 0, sizeof(mask));
+    }
+    int      type;
+    uint32_t id;
+    uint8_t  data[8];    // The data pattern
+    uint8_t  mask[8];    // The pattern mask, 0 bits are ignored
+    uint32_t postFrames; // The frames recorded after the trigger
+};
 
 class CanHistory {
 public:
-	CanHistory() : currMsgPos_(0), numOfEntries_(0) {}
-	void dumpCurrentBuffer();
-	void add2Buffer(const CanMsgBuffer* buff, bool dir, uint8_t mid)
-;
+	enum TriggerState { TRIG_OFF, TRIG_ARMED, TRIG_FIRED, TRIG_FROZEN };
+	static CanHistory* instance();
+	void dumpCurrentBuffer(const HistoryFilter& filter);
+	void add2Buffer(const CanMsgBuffer* buff, bool dir, uint8_t mid);
+	void arm(const HistoryTrigger& trigger);
+	void disarm();
+	void setPostFrames(uint32_t frames) { trigger_.postFrames = frames; }
+	void onEvent(int type);
+	const HistoryTrigger& trigger() const { return trigger_; }
+	int triggerState() const { return state_; }
+	uint32_t triggerSeq() const { return trigSeq_; }
 private:
-	const static int HISTORY_LEN = 16;
-	int      currMsgPos_;
-	int      numOfEntries_;
-	MsgEntry msglog_[HISTORY_LEN];
+	CanHistory() : seq_(0), state_(TRIG_OFF), postLeft_(0), trigSeq_(0) {}
+	bool isSelected(const CanMsgBuffer& entry, const HistoryFilter& filter) const;
+	bool isTriggered(const CanMsgBuffer& entry) const;
+	void fire(uint32_t seq);
+	const static int HISTORY_LEN = CAN_HISTORY_LEN;
+	uint32_t       seq_;          // The sequence number of the next frame
+	CanMsgBuffer   msglog_[HISTORY_LEN];
+	HistoryTrigger trigger_;
+	int            state_;
+	uint32_t       postLeft_;     // The frames to record before freeze
+	uint32_t       trigSeq_;      // The trigger frame sequence number
 };
 
 
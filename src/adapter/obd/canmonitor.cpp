@@ -0,0 +1,281 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include <cstdio>
+#include <CanDriver.h>
+#include "canmonitor.h"
+#include "canhistory.h"
+#include "canaggregator.h"
+
+using namespace util;
+
+/**
+ * The table sort key, 11 bit IDs go first
+ * @param[in] id The CAN ID
+ * @param[in] extended CAN 29 bit flag
+ * @return The key
+ */
+static uint32_t ToKey(uint32_t id, bool extended)
+{
+    return extended ? (id | 0x80000000) : id;
+}
+
+/**
+ * CanMonitor singleton
+ * @return The CanMonitor class instance
+ */
+CanMonitor* CanMonitor::instance()
+{
+    static CanMonitor instance;
+    return &instance;
+}
+
+/**
+ * Construct CanMonitor object, the snapshot is off
+ */
+CanMonitor::CanMonitor() : snapshot_(false)
+{
+    clear();
+}
+
+/**
+ * Process the received frame, borrowed from the driver FIFO
+ * @param[in] msg CanMsgbuffer instance pointer
+ * @return true if the frame is from the monitor filters, false if the protocol reply
+ */
+bool CanMonitor::onFrame(const CanMsgBuffer* msg)
+{
+    // Message log
+    CanHistory::instance()->add2Buffer(msg, false, msg->msgnum);
+
+    if (snapshot_) {
+        update(msg);
+    }
+    if (!msg->msgnum)
+        return false;
+    CanAggregator::instance()->update(msg);
+    return true;
+}
+
+/**
+ * Fire the history bus error trigger if the driver saw the bus error
+ */
+void CanMonitor::checkErrors()
+{
+    if (CanDriver::instance()->takeBusError()) {
+        CanHistory::instance()->onEvent(HistoryTrigger::TRIG_BUS_ERROR);
+    }
+}
+
+/**
+ * Process the frames received between requests, the late replies are dropped
+ */
+void CanMonitor::drain()
+{
+    CanDriver* driver = CanDriver::instance();
+    checkErrors();
+    for (const CanMsgBuffer* msg = driver->peek(); msg; msg = driver->peek()) {
+        onFrame(msg);
+        driver->release();
+    }
+}
+
+/**
+ * Turn on/off the snapshot, all bus frames are received if on
+ * @param[in] enabled The snapshot flag
+ */
+void CanMonitor::setSnapshot(bool enabled)
+{
+    if (enabled) {
+        CanDriver::instance()->setFilterAndMask(0, 0, false, SNAPSHOT_FILTER);
+    }
+    else {
+        CanDriver::instance()->clearFilter(SNAPSHOT_FILTER);
+    }
+    snapshot_ = enabled;
+}
+
+/**
+ * Clear the snapshot table
+ */
+void CanMonitor::clear()
+{
+    count_ = 0;
+    dropped_ = 0;
+}
+
+/**
+ * Binary search of the table entry
+ * @param[in] key The entry key
+ * @param[out] found true if the entry is found
+ * @return The entry index or the insert position if not found
+ */
+int CanMonitor::find(uint32_t key, bool& found) const
+{
+    int lo = 0;
+    int hi = count_;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        const CanMsgBuffer& frame = entries_[mid].frame;
+        if (ToKey(frame.id, frame.extended) < key) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    found = lo < count_ && ToKey(entries_[lo].frame.id, entries_[lo].frame.extended) == key;
+    return lo;
+}
+
+/**
+ * Store the frame as the latest one for its ID
+ * @param[in] msg CanMsgbuffer instance pointer
+ */
+void CanMonitor::update(const CanMsgBuffer* msg)
+{
+    bool found = false;
+    int pos = find(ToKey(msg->id, msg->extended), found);
+
+    if (!found) {
+        if (count_ == SNAPSHOT_SIZE) {
+            dropped_++;
+            return;
+        }
+        memmove(entries_ + pos + 1, entries_ + pos, (count_ - pos) * sizeof(MonitorEntry));
+        count_++;
+    }
+
+    MonitorEntry& entry = entries_[pos];
+    if (!found) {
+        entry.count = 0;
+        entry.dlcMask = 0;
+        entry.minGap = 0xFFFF;
+        entry.maxGap = 0;
+        entry.gapSum = 0;
+    }
+    if (entry.count && entry.count < 0xFFFF) {
+        uint16_t gap = msg->time - entry.frame.time;
+        entry.gapSum += gap;
+        entry.minGap = (gap < entry.minGap) ? gap : entry.minGap;
+        entry.maxGap = (gap > entry.maxGap) ? gap : entry.maxGap;
+    }
+    entry.frame = *msg;
+    entry.dlcMask |= 1 << msg->dlc;
+    if (entry.count < 0xFFFF) {
+        entry.count++;
+    }
+}
+
+/**
+ * Send the table entry, "<time> <count> <ID> <DLC> <data>"
+ * @param[in] entry The table entry
+ * @param[in] extended Use 29 bit ID width
+ */
+void CanMonitor::sendEntry(const MonitorEntry& entry, bool extended) const
+{
+    const CanMsgBuffer& frame = entry.frame;
+    const int prefixLen = 11;
+    fixed_string<REPLY_LEN> out;
+    char prefix[prefixLen + 1];
+
+    sprintf(prefix, "%5u %04X ", static_cast<unsigned>(frame.time), entry.count);
+    out = prefix;
+    CanIDToString(frame.id, out, frame.extended);
+    out.resize(prefixLen + (extended ? 9 : 4), ' ');
+    out += frame.dlc + '0';
+    out += ' ';
+    to_ascii(frame.data, frame.dlc, out);
+    AdptSendReply(out);
+}
+
+/**
+ * Send the ID census line, "<ID> <count> <min> <mean> <max> <DLCs> <last time>",
+ * the inter-arrival times in ms, the DLCs seen as digits
+ * @param[in] entry The table entry
+ * @param[in] extended Use 29 bit ID width
+ */
+void CanMonitor::sendCensus(const MonitorEntry& entry, bool extended) const
+{
+    fixed_string<REPLY_LEN> out;
+    char stats[32];
+
+    CanIDToString(entry.frame.id, out, entry.frame.extended);
+    out.resize(extended ? 9 : 4, ' ');
+
+    unsigned gaps = entry.count - 1;
+    if (gaps) {
+        sprintf(stats, "%04X %5u %5u %5u ", entry.count, entry.minGap,
+                static_cast<unsigned>(entry.gapSum / gaps), entry.maxGap);
+    }
+    else {
+        sprintf(stats, "%04X     -     -     - ", entry.count);
+    }
+    out += stats;
+
+    for (int dlc = 0; dlc <= 8; dlc++) {
+        if (entry.dlcMask & (1 << dlc)) {
+            out += dlc + '0';
+        }
+    }
+    sprintf(stats, " %5u", static_cast<unsigned>(entry.frame.time));
+    out += stats;
+    AdptSendReply(out);
+}
+
+/**
+ * Display the ID census, sorted by ID
+ */
+void CanMonitor::census() const
+{
+    if (!count_) {
+        AdptSendReply("NO DATA");
+        return;
+    }
+
+    bool extended = entries_[count_ - 1].frame.extended;
+    for (int i = 0; i < count_; i++) {
+        sendCensus(entries_[i], extended);
+    }
+}
+
+/**
+ * Display the snapshot table, sorted by ID
+ */
+void CanMonitor::dump() const
+{
+    if (!count_) {
+        AdptSendReply("NO DATA");
+        return;
+    }
+
+    bool extended = entries_[count_ - 1].frame.extended;
+    for (int i = 0; i < count_; i++) {
+        sendEntry(entries_[i], extended);
+    }
+    if (dropped_) {
+        char out[20];
+        sprintf(out, "DROPPED %u", static_cast<unsigned>(dropped_));
+        AdptSendReply(out);
+    }
+}
+
+/**
+ * Display the snapshot table entry
+ * @param[in] id The CAN ID
+ * @param[in] extended CAN 29 bit flag
+ * @return true if found, false otherwise
+ */
+bool CanMonitor::dump(uint32_t id, bool extended) const
+{
+    bool found = false;
+    int pos = find(ToKey(id, extended), found);
+    if (found) {
+        sendEntry(entries_[pos], extended);
+    }
+    return found;
+}
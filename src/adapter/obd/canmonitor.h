@@ -0,0 +1,59 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#ifndef __CAN_MONITOR_H__
+#define __CAN_MONITOR_H__
+
+#include <adaptertypes.h>
+#include <canmsgbuffer.h>
+
+//
+// The latest frame received with the CAN ID and the ID census
+//
+struct MonitorEntry {
+    CanMsgBuffer frame;   // The last payload, DLC and timestamp
+    uint16_t     count;   // Saturated at FFFF
+    uint16_t     dlcMask; // Bit per DLC seen
+    uint16_t     minGap;  // The inter-arrival time, ms
+    uint16_t     maxGap;
+    uint32_t     gapSum;  // The mean is gapSum / (count - 1)
+};
+
+//
+// Every received frame goes here, it is logged in the history, the
+// monitored IDs are passed to the aggregator. With the snapshot on, all
+// bus frames are received and the latest one per ID is kept in the table
+// sorted by ID with the frame count, DLCs and inter-arrival times seen.
+// The new IDs are dropped if the table is full.
+//
+class CanMonitor {
+public:
+    const static uint32_t SNAPSHOT_FILTER = AGGREGATE_SLOTS_LEN + 1; // Catch all filter bank
+    static CanMonitor* instance();
+    bool onFrame(const CanMsgBuffer* msg);
+    void drain();
+    void checkErrors();
+    void setSnapshot(bool enabled);
+    bool snapshot() const { return snapshot_; }
+    void clear();
+    void dump() const;
+    bool dump(uint32_t id, bool extended) const;
+    void census() const;
+private:
+    CanMonitor();
+    void update(const CanMsgBuffer* msg);
+    int find(uint32_t key, bool& found) const;
+    void sendEntry(const MonitorEntry& entry, bool extended) const;
+    void sendCensus(const MonitorEntry& entry, bool extended) const;
+    const static int SNAPSHOT_SIZE = SNAPSHOT_LEN;
+    MonitorEntry entries_[SNAPSHOT_SIZE];
+    int          count_;
+    uint32_t     dropped_; // The frames of IDs not fitting the table
+    bool         snapshot_;
+};
+
+#endif //__CAN_MONITOR_H__
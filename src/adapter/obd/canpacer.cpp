@@ -0,0 +1,96 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include <cstdio>
+#include <Timer.h>
+#include <CanDriver.h>
+#include "canpacer.h"
+#include "canbusmeter.h"
+
+/**
+ * CanPacer singleton
+ * @return The CanPacer class instance
+ */
+CanPacer* CanPacer::instance()
+{
+    static CanPacer instance;
+    return &instance;
+}
+
+/**
+ * Construct CanPacer object, the bucket is full
+ */
+CanPacer::CanPacer()
+  : tokens_(BURST_BITS),
+    throttled_(0),
+    paced_(false)
+{
+    CanBusStatus status;
+    CanDriver::instance()->getStatus(&status);
+    txCount_ = status.txBits;
+    last_ = Clock::now();
+}
+
+/**
+ * Add the tokens for the time passed and take the bits sent since
+ * @param[in] ceiling The bus load ceiling, %
+ */
+void CanPacer::refill(uint32_t ceiling)
+{
+    uint16_t now = Clock::now();
+    uint32_t elapsed = static_cast<uint16_t>(now - last_);
+    last_ = now;
+
+    CanBusStatus status;
+    CanDriver::instance()->getStatus(&status);
+    int32_t sent = status.txBits - txCount_;
+    txCount_ = status.txBits;
+
+    // The load ceiling less the other traffic, 1/1000
+    CanBusMeter* meter = CanBusMeter::instance();
+    uint32_t others = meter->load(1) - meter->txLoad(1);
+    uint32_t share = ceiling * 10;
+    share = (share > others + MIN_SHARE) ? (share - others) : MIN_SHARE;
+
+    elapsed = (elapsed < 1000) ? elapsed : 1000; // The bucket is full by then
+    tokens_ += CanDriver::bitRate() / 1000 * share * elapsed / 1000 - sent;
+    tokens_ = (tokens_ < BURST_BITS) ? tokens_ : BURST_BITS;
+    tokens_ = (tokens_ > -BURST_BITS) ? tokens_ : -BURST_BITS; // The traffic between polls
+}
+
+/**
+ * Check if the adapter request can be sent now, the throttling
+ * event is reported once till the request is allowed again
+ * @return true if allowed, false to hold the request
+ */
+bool CanPacer::allow()
+{
+    uint32_t ceiling = AdapterConfig::instance()->getIntProperty(PAR_LOAD_CEILING);
+    refill(ceiling);
+
+    if (!ceiling || ceiling >= 100 || tokens_ >= 0) {
+        paced_ = false;
+        return true;
+    }
+    if (!paced_) {
+        paced_ = true;
+        throttled_++;
+        AdptSendReply("THROTTLED");
+    }
+    return false;
+}
+
+/**
+ * Display the load ceiling and the number of throttling events
+ */
+void CanPacer::sendStatus() const
+{
+    char out[32];
+    uint32_t ceiling = AdapterConfig::instance()->getIntProperty(PAR_LOAD_CEILING);
+    sprintf(out, "CEILING:%u%% THROTTLED:%u", static_cast<unsigned>(ceiling), throttled_);
+    AdptSendReply(out);
+}
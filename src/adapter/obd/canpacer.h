@@ -0,0 +1,38 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#ifndef __CAN_PACER_H__
+#define __CAN_PACER_H__
+
+#include <adaptertypes.h>
+
+//
+// Token bucket pacing of the adapter own requests. The bucket is filled
+// at the rate the bus load ceiling leaves to the adapter, the load ceiling 
+// minus the other traffic, and drained by the adapter sent frame bits. 
+// The other traffic is the last second whole bus load, CanBusMeter
+// counts all frames with its catch-all filter. The request is held
+// while the bucket is in debt.
+//
+class CanPacer {
+public:
+    const static uint32_t MIN_SHARE  = 10;   // The adapter minimum share, 1/1000
+    const static int32_t  BURST_BITS = 1000; // The bucket size and the debt limit
+    static CanPacer* instance();
+    bool allow();
+    void sendStatus() const;
+private:
+    CanPacer();
+    void refill(uint32_t ceiling);
+    int32_t  tokens_;    // bits, negative is the debt
+    uint32_t txCount_;   // The driver sent bits counter at the last refill
+    uint16_t last_;      // The last refill time, Clock::now() based
+    uint16_t throttled_; // The throttling events
+    bool     paced_;
+};
+
+#endif //__CAN_PACER_H__
@@ -0,0 +1,267 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include <adaptertypes.h>
+#include <algorithms.h>
+#include "canreply.h"
+#include "isocan.h"
+
+using namespace util;
+
+/**
+ * Write CAN identifier as ASCII hex, 3 chars for 11 bit, 8 chars for 29 bit
+ * @param[in] id The CAN identifier
+ * @param[in] extended CAN 29 bit flag
+ * @param[out] out The output position
+ * @return The position after the written characters
+ */
+static char* FormatId(uint32_t id, bool extended, char* out)
+{
+    if (!extended) { // 11 bit standard CAN identifier
+        *out++ = to_ascii((id >> 8) & 0x0F);
+        return to_hex(id, out);
+    }
+    out = to_hex(id >> 24, out);
+    out = to_hex(id >> 16, out);
+    out = to_hex(id >> 8, out);
+    return to_hex(id, out);
+}
+
+/**
+ * Format the CAN frame reply in a single pass, the settings
+ * are the template parameters, so the branches are resolved by compiler
+ * @param[in] msg CanMsgbuffer instance pointer
+ * @param[in] len The number of data bytes to print, 0..8
+ * @param[out] out The output buffer, at least 40 chars
+ * @return The reply length including CR/LF
+ */
+template <bool Header, bool Spaces, bool Dlc, bool Linefeed>
+static uint32_t FormatReply(const CanMsgBuffer* msg, int len, char* out)
+{
+    char* p = out;
+    
+    if (Header) {
+        p = FormatId(msg->id, msg->extended, p);
+        if (Spaces) {
+            *p++ = ' ';
+        }
+        if (Dlc) {
+            *p++ = msg->dlc + '0';
+            if (Spaces) {
+                *p++ = ' ';
+            }
+        }
+    }
+    
+    for (int i = 0; i < len; i++) {
+        if (Spaces && i > 0) {
+            *p++ = ' ';
+        }
+        p = to_hex(msg->data[i], p);
+    }
+    
+    *p++ = '\r';
+    if (Linefeed) {
+        *p++ = '\n';
+    }
+    return p - out;
+}
+
+//
+// Indexed by H << 3 | S << 2 | D << 1 | L
+//
+static const CanReply::FormatT Formatters[] = {
+    FormatReply<false, false, false, false>,
+    FormatReply<false, false, false, true >,
+    FormatReply<false, false, true,  false>,
+    FormatReply<false, false, true,  true >,
+    FormatReply<false, true,  false, false>,
+    FormatReply<false, true,  false, true >,
+    FormatReply<false, true,  true,  false>,
+    FormatReply<false, true,  true,  true >,
+    FormatReply<true,  false, false, false>,
+    FormatReply<true,  false, false, true >,
+    FormatReply<true,  false, true,  false>,
+    FormatReply<true,  false, true,  true >,
+    FormatReply<true,  true,  false, false>,
+    FormatReply<true,  true,  false, true >,
+    FormatReply<true,  true,  true,  false>,
+    FormatReply<true,  true,  true,  true >
+};
+
+/**
+ * CanReply singleton
+ */
+CanReply* CanReply::instance()
+{
+    static CanReply instance;
+    return &instance;
+}
+
+/**
+ * Constructor, pick the formatter for the current settings
+ */
+CanReply::CanReply()
+  : trimPadding_(false),
+    capture_(0)
+{
+    select();
+    AdapterConfig::instance()->addListener(this);
+}
+
+/**
+ * Select the formatter specialization for the current H/S/D/L settings
+ */
+void CanReply::select()
+{
+    const AdapterConfig* config = AdapterConfig::instance();
+    int idx = (config->getBoolProperty(PAR_HEADER_SHOW) << 3) |
+              (config->getBoolProperty(PAR_SPACES)      << 2) |
+              (config->getBoolProperty(PAR_CAN_DLC)     << 1) |
+               config->getBoolProperty(PAR_LINEFEED);
+    format_ = Formatters[idx];
+    trimPadding_ = config->getBoolProperty(PAR_CAN_CAF);
+}
+
+/**
+ * Format the CAN frame reply
+ * @param[in] msg CanMsgbuffer instance pointer
+ * @param[out] out The output buffer, at least 40 chars
+ * @return The reply length including CR/LF
+ */
+uint32_t CanReply::format(const CanMsgBuffer* msg, char* out) const
+{
+    int len = (msg->dlc < 8) ? msg->dlc : 8;
+    if (trimPadding_ && (msg->data[0] & 0xF0) == 0) { // Single frame, PCI has the length
+        int sfLen = (msg->data[0] & 0x0F) + 1;
+        len = (sfLen < len) ? sfLen : len;
+    }
+    return format_(msg, len, out);
+}
+
+/**
+ * Swap the formatter if one of ATH/ATS/ATD/ATL/ATCAF settings changed
+ * @param[in] parameter The changed property
+ */
+void CanReply::onConfigChange(int parameter)
+{
+    switch (parameter) {
+        case PAR_HEADER_SHOW:
+        case PAR_SPACES:
+        case PAR_CAN_DLC:
+        case PAR_LINEFEED:
+        case PAR_CAN_CAF:
+            select();
+            break;
+    }
+}
+
+/**
+ * Send the CAN frame reply, formatted in the UART transmit buffer
+ * @param[in] msg CanMsgbuffer instance pointer
+ */
+void CanReply::send(const CanMsgBuffer* msg)
+{
+    if (capture_) {
+        capture_->add(msg);
+        return;
+    }
+    char* out = AdptGetTxBuffer();
+    const char* tag = AdptGetReplyTag();
+    uint32_t len = strlen(tag);
+    memcpy(out, tag, len);
+    AdptSendTxBuffer(len + format(msg, out + len));
+}
+
+/**
+ * Send the reply message as ISO 15765-2 single or first and consecutive
+ * frames, the inverse of CanReplyCapture
+ * @param[in] id The responder CAN ID
+ * @param[in] extended CAN 29 bit flag
+ * @param[in] data The message bytes
+ * @param[in] len The message length
+ */
+void CanReply::sendMessage(uint32_t id, bool extended, const uint8_t* data, int len)
+{
+    if (len <= 7) {
+        CanMsgBuffer msg(id, extended, 8, len);
+        memcpy(msg.data + 1, data, len);
+        send(&msg);
+        return;
+    }
+
+    CanMsgBuffer msg(id, extended, 8, 0x10 | ((len >> 8) & 0x0F), len & 0xFF);
+    memcpy(msg.data + 2, data, 6);
+    send(&msg);
+    
+    uint8_t sn = 1;
+    for (int pos = 6; pos < len; pos += 7, sn++) {
+        int count = ((len - pos) < 7) ? (len - pos) : 7;
+        msg = CanMsgBuffer(id, extended, 8, 0x20 | (sn & 0x0F));
+        memcpy(msg.data + 1, data + pos, count);
+        send(&msg);
+    }
+}
+
+/**
+ * Clear the captured message
+ */
+void CanReplyCapture::reset()
+{
+    id = 0;
+    extended = false;
+    len = received = 0;
+    sn = 0;
+}
+
+/**
+ * Add the single, first or consecutive frame to the message,
+ * the frames of other responders are ignored
+ * @param[in] msg CanMsgbuffer instance pointer
+ */
+void CanReplyCapture::add(const CanMsgBuffer* msg)
+{
+    int pos = 1;
+    int count = 0;
+    
+    if (id && msg->id != id)
+        return;
+    
+    switch (msg->data[0] >> 4) {
+        case IsoCanAdapter::CANSingleFrame:
+            if (len)
+                return;
+            len = msg->data[0] & 0x0F;
+            count = (len < 7) ? len : 7;
+            break;
+        case IsoCanAdapter::CANFirstFrame:
+            if (len)
+                return;
+            len = ((msg->data[0] & 0x0F) << 8) | msg->data[1];
+            pos = 2;
+            count = 6;
+            sn = 1;
+            break;
+        case IsoCanAdapter::CANConsecutiveFrame:
+            if (!len || complete() || (msg->data[0] & 0x0F) != sn)
+                return;
+            sn = (sn + 1) & 0x0F;
+            count = len - received;
+            count = (count < 7) ? count : 7;
+            break;
+        default:
+            return;
+    }
+    
+    id = msg->id;
+    extended = msg->extended;
+    for (int i = 0; i < count; i++, received++) {
+        if (received < DATA_LEN) {
+            data[received] = msg->data[pos + i];
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#ifndef __CAN_REPLY_H__
+#define __CAN_REPLY_H__
+
+#include <adaptertypes.h>
+#include <canmsgbuffer.h>
+
+//
+// The reply message reassembled from ISO 15765-2 frames of the first
+// responder, collected instead of sending the frames to the host
+//
+struct CanReplyCapture {
+    const static int DATA_LEN = 32;
+    CanReplyCapture() { reset(); }
+    void reset();
+    void add(const CanMsgBuffer* msg);
+    bool complete() const { return len > 0 && received >= len; }
+    uint32_t id;
+    bool     extended;
+    uint16_t len;      // The message length from PCI
+    uint16_t received;
+    uint8_t  sn;       // The next consecutive frame sequence number
+    uint8_t  data[DATA_LEN];
+};
+
+//
+// Formats the received CAN frame straight into the UART transmit buffer,
+// the formatter is specialized for the current H/S/D/L settings.
+// Only DLC bytes are printed, with CAF1 the single frame is trimmed
+// to its PCI length to drop the padding.
+//
+class CanReply : public ConfigListener {
+public:
+    typedef uint32_t (*FormatT)(const CanMsgBuffer* msg, int len, char* out);
+    static CanReply* instance();
+    virtual void onConfigChange(int parameter);
+    uint32_t format(const CanMsgBuffer* msg, char* out) const;
+    void send(const CanMsgBuffer* msg);
+    void sendMessage(uint32_t id, bool extended, const uint8_t* data, int len);
+    void capture(CanReplyCapture* capture) { capture_ = capture; }
+private:
+    CanReply();
+    void select();
+    
+    FormatT format_;
+    bool    trimPadding_;
+    CanReplyCapture* capture_; // Collect the frames if set
+};
+
+#endif //__CAN_REPLY_H__
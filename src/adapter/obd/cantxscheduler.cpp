@@ -0,0 +1,215 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <CanDriver.h>
+#include "cantxscheduler.h"
+
+using namespace util;
+
+/**
+ * CanTxScheduler singleton
+ * @return The CanTxScheduler class instance
+ */
+CanTxScheduler* CanTxScheduler::instance()
+{
+    static CanTxScheduler instance;
+    return &instance;
+}
+
+/**
+ * Construct CanTxScheduler object, the table is empty
+ */
+CanTxScheduler::CanTxScheduler()
+  : timer_(TickCallback),
+    ticking_(false)
+{
+    for (int i = 0; i < TX_LEN; i++) {
+        entries_[i].period = 0;
+        entries_[i].running = false;
+    }
+}
+
+/**
+ * The tick interrupt handler
+ */
+void CanTxScheduler::TickCallback()
+{
+    instance()->onTick();
+}
+
+/**
+ * Send the due frames, up to 2 mailboxes are used. The frame not sent
+ * for the lack of a mailbox is tried again on the next ticks
+ */
+void CanTxScheduler::onTick()
+{
+    CanDriver* driver = CanDriver::instance();
+
+    for (int i = 0; i < TX_LEN; i++) {
+        TxEntry& entry = entries_[i];
+        if (!entry.running)
+            continue;
+        if (entry.pending) {
+            entry.late++;
+        }
+        if (--entry.left == 0) {
+            if (entry.pending) {
+                entry.missed++;
+            }
+            entry.pending = true;
+            entry.late = 0;
+            entry.left = entry.period;
+        }
+        // One mailbox is left for the foreground requests
+        if (!entry.pending || driver->freeMailboxes() < 2 || !driver->send(&entry.frame))
+            continue;
+
+        uint32_t jitter = entry.late * TickTimer::TICK_US + TickTimer::sinceTick();
+        jitter = (jitter < 0xFFFF) ? jitter : 0xFFFF;
+        entry.maxJitter = (jitter > entry.maxJitter) ? jitter : entry.maxJitter;
+        entry.pending = false;
+        if (entry.sent < 0xFFFF) {
+            entry.jitterSum += jitter;
+            entry.sent++;
+        }
+    }
+}
+
+/**
+ * Run the tick only with the running entries
+ */
+void CanTxScheduler::updateTimer()
+{
+    bool running = false;
+    for (int i = 0; i < TX_LEN; i++) {
+        running = running || entries_[i].running;
+    }
+    if (running && !ticking_) {
+        timer_.start();
+    }
+    else if (!running && ticking_) {
+        timer_.stop();
+    }
+    ticking_ = running;
+}
+
+/**
+ * Register the frame in the first free slot, stopped
+ * @param[in] period The period, ms
+ * @param[in] frame The frame to send
+ * @return The slot number, -1 if the table is full or parameters are invalid
+ */
+int CanTxScheduler::add(uint32_t period, const CanMsgBuffer& frame)
+{
+    if (period == 0 || period > MAX_PERIOD)
+        return -1;
+
+    for (int i = 0; i < TX_LEN; i++) {
+        TxEntry& entry = entries_[i];
+        if (entry.period)
+            continue;
+        entry.frame = frame;
+        entry.period = period;
+        return i;
+    }
+    return -1;
+}
+
+/**
+ * Stop and free the slot
+ * @param[in] slot The slot number
+ * @return true if the slot was used, false otherwise
+ */
+bool CanTxScheduler::remove(int slot)
+{
+    if (!stop(slot))
+        return false;
+    entries_[slot].period = 0;
+    return true;
+}
+
+/**
+ * Stop and free all slots
+ */
+void CanTxScheduler::clear()
+{
+    for (int i = 0; i < TX_LEN; i++) {
+        entries_[i].running = false;
+        entries_[i].period = 0;
+    }
+    updateTimer();
+}
+
+/**
+ * Start sending the frame, the first one goes on the next tick
+ * @param[in] slot The slot number
+ * @return true if the slot is used, false otherwise
+ */
+bool CanTxScheduler::start(int slot)
+{
+    if (slot < 0 || slot >= TX_LEN || !entries_[slot].period)
+        return false;
+
+    TxEntry& entry = entries_[slot];
+    if (!entry.running) {
+        entry.left = 1;
+        entry.late = 0;
+        entry.sent = 0;
+        entry.missed = 0;
+        entry.maxJitter = 0;
+        entry.jitterSum = 0;
+        entry.pending = false;
+        entry.running = true; // The interrupt owns the entry now
+    }
+    updateTimer();
+    return true;
+}
+
+/**
+ * Stop sending the frame, the statistics are kept
+ * @param[in] slot The slot number
+ * @return true if the slot is used, false otherwise
+ */
+bool CanTxScheduler::stop(int slot)
+{
+    if (slot < 0 || slot >= TX_LEN || !entries_[slot].period)
+        return false;
+
+    entries_[slot].running = false;
+    updateTimer();
+    return true;
+}
+
+/**
+ * Display the table, "<slot>: <period> <ID> <data> ON|OFF <sent> <missed> 
+ * <mean jitter> <max jitter>", the jitter in us
+ */
+void CanTxScheduler::list() const
+{
+    fixed_string<REPLY_LEN> out;
+    char str[32];
+
+    for (int i = 0; i < TX_LEN; i++) {
+        const TxEntry& entry = entries_[i];
+        if (!entry.period)
+            continue;
+        sprintf(str, "%X: %04X ", i, entry.period);
+        out = str;
+        CanIDToString(entry.frame.id, out, entry.frame.extended);
+        out += ' ';
+        to_ascii(entry.frame.data, entry.frame.dlc, out);
+
+        uint32_t sent = entry.sent;
+        uint32_t mean = sent ? (entry.jitterSum / sent) : 0;
+        sprintf(str, " %s %04X %u %u %u", entry.running ? "ON" : "OFF", 
+                static_cast<unsigned>(sent), entry.missed, static_cast<unsigned>(mean), entry.maxJitter);
+        out += str;
+        AdptSendReply(out);
+    }
+}
@@ -0,0 +1,58 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#ifndef __CAN_TX_SCHEDULER_H__
+#define __CAN_TX_SCHEDULER_H__
+
+#include <adaptertypes.h>
+#include <canmsgbuffer.h>
+#include <Timer.h>
+
+//
+// The user defined frame sent with the period
+//
+struct TxEntry {
+    CanMsgBuffer      frame;
+    uint16_t          period;    // ms, 0 - free slot
+    uint16_t          left;      // The ticks to the next send
+    uint16_t          late;      // The ticks the pending frame waits for a mailbox
+    uint16_t          sent;      // Saturated at FFFF
+    uint16_t          missed;    // The periods with no free mailbox
+    uint16_t          maxJitter; // us, the send time after the due tick
+    uint32_t          jitterSum;
+    volatile uint8_t  running;
+    uint8_t           pending;
+};
+
+//
+// Sends the periodic frames from the 1 ms tick interrupt, the interrupt
+// owns the running entries. One of 3 mailboxes is always left free for
+// the foreground requests. The frame waits for a mailbox till the next
+// period, the send delay is reported as the entry jitter.
+//
+class CanTxScheduler {
+public:
+    const static uint32_t MAX_PERIOD = 0xFFFF; // ms
+    static CanTxScheduler* instance();
+    int add(uint32_t period, const CanMsgBuffer& frame);
+    bool remove(int slot);
+    void clear();
+    bool start(int slot);
+    bool stop(int slot);
+    void list() const;
+private:
+    CanTxScheduler();
+    static void TickCallback();
+    void onTick();
+    void updateTimer();
+    const static int TX_LEN = PERIODIC_TX_LEN;
+    TxEntry   entries_[TX_LEN];
+    TickTimer timer_;
+    bool      ticking_;
+};
+
+#endif //__CAN_TX_SCHEDULER_H__
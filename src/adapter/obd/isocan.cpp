@@ -14,40 +14,79 @@
 #include "obdprofile.h"
 #include "isocan.h"
 #include "canhistory.h"
+#include "canreply.h"
+#include "canmonitor.h"
 
 using namespace std;
 using namespace util;
 
 const int ISO_CAN_LEN = 7;
+const uint8_t TesterPresent[] = { 0x3E, 0x80 }; // Suppressed response
 
 IsoCanAdapter::IsoCanAdapter()
 {
     extended_ = false;
-    canPriority_ = 0;
-    filter_[0] = mask_[0] = 0;
+    settingsChanged_ = true;
+    txId_ = fcId_ = filter_ = mask_ = 0;
+    lastSent_ = lastWakeup_ = 0;
     driver_ = CanDriver::instance();
-    history_ = new CanHistory();
+    history_ = CanHistory::instance();
+    monitor_ = CanMonitor::instance();
+    config_->addListener(this);
 }
 
 /**
+ * Compose CAN ID from the header bytes, the last byte is the lowest one
+ * @param[in] header The header bytes
+ * @param[in] priority The highest byte for CAN 29 bit
+ * @return CAN ID
+ */
+static uint32_t HeaderToID(const ByteArray* header, uint8_t priority)
+{
+    NumericType id(0, 0, 0, priority);
+    for (int i = 0; i < header->length && i < 3; i++) {
+        id.bvalue[i] = header->data[header->length - 1 - i];
+    }
+    return id.lvalue;
+}
 
- * Setting CAN custom filter
- * @param[in] filter The filter bytes
+/**
+ * Mark the cached IDs, filter and mask for rebuild if their settings changed
+ * @param[in] parameter The changed property
  */
-void IsoCanAdapter::setFilter(const uint8_t* filter)
+void IsoCanAdapter::onConfigChange(int parameter)
 {
-    memcpy(filter_, filter, sizeof(filter_));
-    setFilterAndMask();
+    switch (parameter) {
+        case PAR_HEADER_BYTES:
+        case PAR_CAN_CF:
+        case PAR_CAN_CM:
+        case PAR_CAN_CP:
+        case PAR_CAN_FLOW_CTRL_HDR:
+            settingsChanged_ = true;
+            break;
+    }
 }
 
 /**
- * Setting CAN custom mask
- * @param[in] mask The mask bytes
+ * Rebuild the cached IDs, filter and mask and reload the CAN filter, if changed
  */
-void IsoCanAdapter::setMask(const uint8_t* mask)
+void IsoCanAdapter::checkSettings()
 {
-    memcpy(mask_, mask, sizeof(mask_));
-    setFilterAndMask();
+    if (settingsChanged_) {
+        setFilterAndMask();
+    }
+}
+
+/**
+ * Load the CAN filter and mask
+ */
+void IsoCanAdapter::setFilterAndMask()
+{
+    if (settingsChanged_) {
+        updateSettings();
+        settingsChanged_ = false;
+    }
+    driver_->setFilterAndMask(filter_, mask_, extended_);
 }
 
 /**
@@ -61,39 +100,56 @@ bool IsoCanAdapter::sendToEcu(const uint8_t* data, int len)
     if (len > ISO_CAN_LEN) {
         return false; // REPLY_DATA_ERROR
     }
-    CanMsgBuffer msgBuffer(getID(), extended_, 8, 0);
-    msgBuffer.data[0] = len;
-    memcpy(msgBuffer.data + 1, data, len);
-    
+    checkSettings();
+    request_ = CanMsgBuffer(txId_, extended_, 8, 0);
+    request_.data[0] = len;
+    memcpy(request_.data + 1, data, len);
+    return sendRequest();
+}
+
+/**
+ * Send the prepared request frame to ECU
+ * @return true if OK, false if data issues
+ */
+bool IsoCanAdapter::sendRequest()
+{
+    lastSent_ = Clock::now();
+
     // Message log
-    history_->add2Buffer(&msgBuffer, true, 0);
+    history_->add2Buffer(&request_, true, 0);
 
-    if (!driver_->send(&msgBuffer)) { 
-        return false; // REPLY_DATA_ERROR
-    }
+    if (!driver_->send(&request_))
+        return false; // REPLY_DATA_ERROR, no free mailbox
     return true;
 }
 
 /**
- * Format reply for "H1" option
- * @param[in] msg CanMsgbuffer instance pointer
- * @param[out] str The output string
+ * Send the wakeup message "ATWM", tester present by default, if neither
+ * a request nor the wakeup was sent for the wakeup period "ATSW". The wakeup
+ * is not logged and leaves the repeat request frame as is, the ECU replies
+ * are dropped.
  */
-void IsoCanAdapter::formatReplyWithHeader(const CanMsgBuffer* msg, util::string& str)
+void IsoCanAdapter::onIdle()
 {
-    CanIDToString(msg->id, str, msg->extended);
-    bool useSpaces = AdapterConfig::instance()->getBoolProperty(PAR_SPACES);
-    bool isDLC = AdapterConfig::instance()->getBoolProperty(PAR_CAN_DLC);
-    if (useSpaces) {
-        str += ' '; // number of chars + space
-    }
-    if (isDLC) {
-        str += msg->dlc + '0'; // add DLC byte
-        if (useSpaces) {
-            str += ' ';
-        }
-    }
-    to_ascii(msg->data, 8, str);
+    // ATSW is in 20.48 ms units, ATSW00 is off
+    uint32_t interval = config_->getIntProperty(PAR_WAKEUP_VAL) * 2048 / 100;
+    if (!connected_ || !interval)
+        return;
+
+    monitor_->drain();
+    uint16_t now = Clock::now();
+    if (static_cast<uint16_t>(now - lastSent_) < interval || static_cast<uint16_t>(now - lastWakeup_) < interval)
+        return;
+
+    const ByteArray* msg = config_->getBytesProperty(PAR_WM_HEADER);
+    const uint8_t* data = msg->length ? msg->data : TesterPresent;
+    int len = msg->length ? msg->length : sizeof(TesterPresent);
+    
+    checkSettings();
+    CanMsgBuffer wakeup(txId_, extended_, 8, len);
+    memcpy(wakeup.data + 1, data, len);
+    driver_->send(&wakeup);
+    lastWakeup_ = now;
 }
 
 /**
@@ -102,57 +158,94 @@ void IsoCanAdapter::formatReplyWithHeader(const CanMsgBuffer* msg, util::string&
  */
 void IsoCanAdapter::processFrame(const CanMsgBuffer* msg)
 {
-    util::string str;
-    if (config_->getBoolProperty(PAR_HEADER_SHOW)) {
-        formatReplyWithHeader(msg, str);
+    CanReply::instance()->send(msg);
+}
+
+/**
+ * Check the frame DLC covers the ISO 15765-2 PCI, "ATV1"
+ * @param[in] msg CanMsgbuffer instance pointer
+ * @return true if DLC is valid, false otherwise
+ */
+static bool IsValidDlc(const CanMsgBuffer* msg)
+{
+    if (msg->dlc == 0 || msg->dlc > 8)
+        return false;
+    
+    switch (msg->data[0] >> 4) {
+        case IsoCanAdapter::CANSingleFrame: {
+            int len = msg->data[0] & 0x0F;
+            return len > 0 && len < msg->dlc;
+        }
+        case IsoCanAdapter::CANFirstFrame:
+            return msg->dlc == 8;
+        case IsoCanAdapter::CANConsecutiveFrame:
+            return msg->dlc > 1;
+        case IsoCanAdapter::CANFlowControlFrame:
+            return msg->dlc >= 3;
     }
-    else {
-        to_ascii(msg->data, 8, str);
+    return false;
+}
+
+/**
+ * Log and report the received frame, borrowed from the driver FIFO
+ * @param[in] msg CanMsgbuffer instance pointer
+ * @param[in] sendReply send reply to user flag
+ * @return true if the frame is accepted, false if malformed
+ */
+bool IsoCanAdapter::receiveFrame(const CanMsgBuffer* msg, bool sendReply)
+{
+    // Message log, the monitored ID frame is not a reply
+    if (monitor_->onFrame(msg))
+        return false;
+    
+    // Ignore the malformed frame
+    if (config_->getBoolProperty(PAR_CAN_VAIDATE_DLC) && !IsValidDlc(msg))
+        return false;
+    
+    if (!sendReply)
+        return true;
+    switch ((msg->data[0] & 0xF0) >> 4) {
+        case CANSingleFrame:
+            processFrame(msg);
+            break;
+        case CANFirstFrame:
+            processFlowFrame(msg);
+            processFrame(msg);
+            break;
+        case CANConsecutiveFrame:
+            processFrame(msg);
+            break;
     }
-    AdptSendReply(str);
+    return true;
 }
 
 /**
- * Receives a sequence of bytes from the CAN bus
+ * Receives a sequence of bytes from the CAN bus, stops on timeout
+ * or when the host sent a character
  * @param[in] sendReply send reply to user flag
  * @return true if message received, false otherwise
  */
 bool IsoCanAdapter::receiveFromEcu(bool sendReply)
 {
     const int p2Timeout = getP2MaxTimeout();
-    CanMsgBuffer msgBuffer;
     bool msgReceived = false;
     
     Timer* timer = Timer::instance(0);
     timer->start(p2Timeout);
 
     do {
-        if (!driver_->isReady())
+        monitor_->checkErrors();
+        const CanMsgBuffer* msg = driver_->peek();
+        if (!msg)
             continue;
-        driver_->read(&msgBuffer);
         
-        // Message log
-        history_->add2Buffer(&msgBuffer, false, msgBuffer.msgnum);
-        
-        // Reload the timer
-        timer->start(p2Timeout);
-
-        msgReceived = true;
-        if (!sendReply)
-            continue;
-        switch ((msgBuffer.data[0] & 0xF0) >> 4) {
-            case CANSingleFrame:
-                processFrame(&msgBuffer);
-                break;
-            case CANFirstFrame:
-                processFlowFrame(&msgBuffer);
-                processFrame(&msgBuffer);
-                break;
-            case CANConsecutiveFrame:
-                processFrame(&msgBuffer);
-                break;
+        if (receiveFrame(msg, sendReply)) {
+            // Reload the timer
+            timer->start(p2Timeout);
+            msgReceived = true;
         }
-    } while (!timer->isExpired());
+        driver_->release();
+    } while (!timer->isExpired() && !AdptIsAborted());
 
     return msgReceived;
 }
@@ -174,7 +267,40 @@ int IsoCanAdapter::onRequest(const uint8_t* data, int len)
 {
     if (!sendToEcu(data, len))
         return REPLY_DATA_ERROR;
-    return receiveFromEcu(true) ? REPLY_NONE : REPLY_NO_DATA;
+    return receiveReply();
+}
+
+/**
+ * Send the same request again, the frame prepared last time is sent as is
+ * @param[in] data The message data bytes
+ * @param[in] len The message length
+ * @return The completion status code
+ */
+int IsoCanAdapter::onRepeatRequest(const uint8_t* data, int len)
+{
+    bool prepared = (request_.data[0] == len) && (memcmp(request_.data + 1, data, len) == 0);
+    if (!prepared) {
+        return onRequest(data, len);
+    }
+    if (!sendRequest())
+        return REPLY_DATA_ERROR;
+    return receiveReply();
+}
+
+/**
+ * Receive the reply for the request just sent
+ * @return The completion status code
+ */
+int IsoCanAdapter::receiveReply()
+{
+    bool msgReceived = receiveFromEcu(true);
+    if (AdptIsAborted())
+        return REPLY_STOPPED;
+    if (!msgReceived) {
+        history_->onEvent(HistoryTrigger::TRIG_TIMEOUT);
+        return REPLY_NO_DATA;
+    }
+    return REPLY_NONE;
 }
 
 /**
@@ -184,9 +310,9 @@ int IsoCanAdapter::onRequest(const uint8_t* data, int len)
  */
 int IsoCanAdapter::onConnectEcu(bool sendReply)
 {
-    CanMsgBuffer msgBuffer(getID(), extended_, 8, 0x02, 0x01, 0x00);
-
     open();
+    
+    CanMsgBuffer msgBuffer(txId_, extended_, 8, 0x02, 0x01, 0x00);
 
     switch (OBDProfile::instance()->getProtocol()) {
     	case PROT_ISO15765_1150:
@@ -199,7 +325,7 @@ int IsoCanAdapter::onConnectEcu(bool sendReply)
     }
 
     if (driver_->send(&msgBuffer)) { 
-        if (receiveFromEcu(sendReply)) {
+        if (receiveFromEcu(sendReply) && !AdptIsAborted()) {
             connected_ = true;
             return extended_ ? PROT_ISO15765_2950 : PROT_ISO15765_1150;
         }
@@ -210,10 +336,11 @@ int IsoCanAdapter::onConnectEcu(bool sendReply)
 
 /**
  * Print the messages buffer
+ * @param[in] filter The frames to display
  */
-void IsoCanAdapter::dumpBuffer()
+void IsoCanAdapter::dumpBuffer(const HistoryFilter& filter)
 {
-    history_->dumpCurrentBuffer();
+    history_->dumpCurrentBuffer(filter);
 }
 
 /**
@@ -256,51 +383,27 @@ void IsoCan11Adapter::open()
     AdptLED::instance()->startTimer();
 }
 
-uint32_t IsoCan11Adapter::getID() const
-{ 
-    NumericType id;
-
-    const ByteArray* bytes = config_->getBytesProperty(PAR_WM_HEADER);
-    if (bytes->length) {
-        const uint8_t* customHdr = bytes->data;
-        id.bvalue[1] = customHdr[2] & 0x07;
-        id.bvalue[0] = customHdr[3];
-    }
-    else {
-        id.lvalue = 0x7DF;
-    }
-    return id.lvalue;
-}
-
-void IsoCan11Adapter::setFilterAndMask()
+/**
+ * Rebuild the IDs, filter and mask from the configuration
+ */
+void IsoCan11Adapter::updateSettings()
 {
-    // Mask 11 bit
-    NumericType mask;
-
-    if (isCustomMask()) {
-        mask.bvalue[1] = mask_[3] & 0x07;
-        mask.bvalue[0] = mask_[4];
-    }
-    else { // Default mask for 11 bit CAN
-        mask.lvalue = 0x7F8;
-    }
-    // Filter 11 bit
-    NumericType filter;
-    if (isCustomFilter()) {
-        filter.bvalue[1] = filter_[3] & 0x07;
-        filter.bvalue[0] = filter_[4];
-    }
-    else { // Default filter for 11 bit CAN
-        filter.lvalue = 0x7E8;
-    }
-    // Set mask and filter 11 bit
-    driver_->setFilterAndMask(filter.lvalue, mask.lvalue, false);
+    const ByteArray* header = config_->getBytesProperty(PAR_HEADER_BYTES);
+    txId_ = header->length ? (HeaderToID(header, 0) & 0x7FF) : 0x7DF;
+    fcId_ = config_->getIntProperty(PAR_CAN_FLOW_CTRL_HDR) & 0x7FF;
+    
+    // Default filter and mask for 11 bit CAN
+    uint32_t filter = config_->getIntProperty(PAR_CAN_CF);
+    uint32_t mask = config_->getIntProperty(PAR_CAN_CM);
+    filter_ = filter ? (filter & 0x7FF) : 0x7E8;
+    mask_ = mask ? (mask & 0x7FF) : 0x7F8;
 }
 
 void IsoCan11Adapter::processFlowFrame(const CanMsgBuffer* msg)
 {
-    CanMsgBuffer ctrlData(getID(), false, 8, 0x30, 0x0, 0x00);
-    ctrlData.id |= (msg->id & 0x07);
+    // Send to the physical address of the responder, 7E8 -> 7E0
+    uint32_t id = fcId_ ? fcId_ : (msg->id - 8);
+    CanMsgBuffer ctrlData(id, false, 8, 0x30, 0x0, 0x00);
     driver_->send(&ctrlData);
     
     // Message log
@@ -330,57 +433,31 @@ void IsoCan29Adapter::open()
     AdptLED::instance()->startTimer();
 }
 
-uint32_t IsoCan29Adapter::getID() const
-{ 
-    NumericType id;
-
-    const ByteArray* bytes = config_->getBytesProperty(PAR_WM_HEADER);
-    if (bytes->length) {
-        const uint8_t* customHdr = bytes->data;
-        id.bvalue[3] = canPriority_;
-        id.bvalue[2] = customHdr[1];
-        id.bvalue[1] = customHdr[2];
-        id.bvalue[0] = customHdr[3];
-    }
-    else {
-        id.lvalue = 0x18DB33F1;
-    }
-    return id.lvalue;
-}
-
-void IsoCan29Adapter::setFilterAndMask() 
+/**
+ * Rebuild the IDs, filter and mask from the configuration
+ */
+void IsoCan29Adapter::updateSettings()
 {
-    // Mask 29 bit
-    NumericType mask;
-
-    if (isCustomMask()) {
-        mask.bvalue[3] = mask_[1];
-        mask.bvalue[2] = mask_[2];
-        mask.bvalue[1] = mask_[3];
-        mask.bvalue[0] = mask_[4];
-    }
-    else { // Default for 29 bit CAN
-        mask.lvalue = 0x1FFFFF00;
-    }
-    // Filter 29 bit
-    NumericType filter;
-    if (isCustomFilter()) {
-        filter.bvalue[3] = filter_[1];
-        filter.bvalue[2] = filter_[2];
-        filter.bvalue[1] = filter_[3];
-        filter.bvalue[0] = filter_[4];
-    }
-    else { // Default for 29 bit CAN
-        filter.lvalue = 0x18DAF100;
-    }
-    // Set mask and filter 29 bit
-    driver_->setFilterAndMask(filter.lvalue, mask.lvalue, true);
+    const ByteArray* header = config_->getBytesProperty(PAR_HEADER_BYTES);
+    uint8_t priority = config_->getIntProperty(PAR_CAN_CP);
+    txId_ = header->length ? (HeaderToID(header, priority) & 0x1FFFFFFF) : 0x18DB33F1;
+    fcId_ = config_->getIntProperty(PAR_CAN_FLOW_CTRL_HDR) & 0x1FFFFFFF;
+
+    // Default filter and mask for 29 bit CAN
+    uint32_t filter = config_->getIntProperty(PAR_CAN_CF);
+    uint32_t mask = config_->getIntProperty(PAR_CAN_CM);
+    filter_ = filter ? (filter & 0x1FFFFFFF) : 0x18DAF100;
+    mask_ = mask ? (mask & 0x1FFFFFFF) : 0x1FFFFF00;
 }
 
 void IsoCan29Adapter::processFlowFrame(const CanMsgBuffer* msg)
 {
-    CanMsgBuffer ctrlData(getID(), true, 8, 0x30, 0x0, 0x00);
-    ctrlData.id |= (msg->id & 0xFF) << 8;
+    // Swap the target and source addresses, 18DAF110 -> 18DA10F1
+    uint32_t id = fcId_;
+    if (!id) {
+        id = (msg->id & 0xFFFF0000) | ((msg->id & 0xFF) << 8) | ((msg->id >> 8) & 0xFF);
+    }
+    CanMsgBuffer ctrlData(id, true, 8, 0x30, 0x0, 0x00);
     driver_->send(&ctrlData);
     
     // Message log
@@ -6,14 +6,15 @@
 #define __ISO_CAN_H__
 
 #include "padapter.h"
+#include <canmsgbuffer.h>
 
 const int CAN_P2_MAX_TIMEOUT = 50;
 
 class CanDriver;
 class CanHistory;
-struct CanMsgBuffer;
+class CanMonitor;
 
-class IsoCanAdapter : public ProtocolAdapter {
+class IsoCanAdapter : public ProtocolAdapter, public ConfigListener {
 public:
     static const int CANSingleFrame      = 0;
     static const int CANFirstFrame       = 1;
@@ -21,32 +22,39 @@ public:
     static const int CANFlowControlFrame = 3;
 public:
     virtual int onRequest(const uint8_t* data, int len);
+    virtual int onRepeatRequest(const uint8_t* data, int len);
     virtual int onConnectEcu(bool sendReply);
-    virtual void setFilter(const uint8_t* filter);
-    virtual void setMask(const uint8_t* mask);
     virtual void setCanCAF(bool val) {}
-    virtual void setPriorityByte(uint8_t val) { canPriority_ = val; }
     virtual void wiringCheck();
-    virtual void dumpBuffer();
+    virtual void dumpBuffer(const HistoryFilter& filter);
+    virtual void onConfigChange(int parameter);
+    virtual void onIdle();
 protected:
     IsoCanAdapter();
-    virtual uint32_t getID() const = 0;
-    virtual void setFilterAndMask() = 0;
+    virtual void updateSettings() = 0;
     virtual void processFlowFrame(const CanMsgBuffer* msgBuffer) = 0;
+    void checkSettings();
+    void setFilterAndMask();
     bool sendToEcu(const uint8_t* data, int len);
+    bool sendRequest();
+    int receiveReply();
     bool receiveFromEcu(bool sendReply);
-    bool isCustomMask() const { return mask_[0] != 0; }
-    bool isCustomFilter() const { return filter_[0] != 0; }
+    bool receiveFrame(const CanMsgBuffer* msg, bool sendReply);
     void processFrame(const CanMsgBuffer* msg);
-    void formatReplyWithHeader(const CanMsgBuffer* msg, util::string& str);
     int getP2MaxTimeout() const;
     //
     CanDriver*  driver_;
     CanHistory* history_;
+    CanMonitor* monitor_;
+    CanMsgBuffer request_;     // The last request frame, reused on repeat
     bool        extended_;
-    uint8_t     canPriority_;
-    uint8_t     filter_[5];    // 4 bytes + length
-    uint8_t     mask_[5];      // 4 bytes + length
+    bool        settingsChanged_; // Rebuild the values below
+    uint32_t    txId_;            // Request CAN ID
+    uint32_t    fcId_;            // Flow control CAN ID, 0 if derived from reply
+    uint32_t    filter_;
+    uint32_t    mask_;
+    uint16_t    lastSent_;        // The last request time, Clock::now() based
+    uint16_t    lastWakeup_;      // The last wakeup message time
 };
 
 class IsoCan11Adapter : public IsoCanAdapter {
@@ -54,8 +62,7 @@ public:
     IsoCan11Adapter() {}
     virtual void getDescription();
     virtual void getDescriptionNum();
-    virtual uint32_t getID() const;
-    virtual void setFilterAndMask();
+    virtual void updateSettings();
     virtual void processFlowFrame(const CanMsgBuffer* msgBuffer);
     virtual int getProtocol() const { return PROT_ISO15765_1150; }
     virtual void open();
@@ -67,8 +74,7 @@ public:
     IsoCan29Adapter() { extended_ = true; }
     virtual void getDescription();
     virtual void getDescriptionNum();
-    virtual uint32_t getID() const;
-    virtual void setFilterAndMask();
+    virtual void updateSettings();
     virtual void processFlowFrame(const CanMsgBuffer* msgBuffer);
     virtual int getProtocol() const { return PROT_ISO15765_2950; }
     virtual void open();
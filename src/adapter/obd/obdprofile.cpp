@@ -21,6 +21,7 @@ static const char Err5Message[] = "FB ERROR";          // Wiring
 static const char Err6Message[] = "BUS BUSY";          // Bus collision or busy
 static const char Err7Message[] = "BUS ERROR";         // Bus error
 static const char Err8Message[] = "DATA ERROR>";       // Checksum
+static const char Err9Message[] = "STOPPED";           // Interrupted by the host
 static const char Err0Message[] = "Program Error";     // Wrong coding?
 
 
@@ -54,9 +55,9 @@ void OBDProfile::getProtocolDescriptionNum() const
     adapter_->getDescriptionNum();
 }
 
-void OBDProfile::dumpBuffer()
+void OBDProfile::dumpBuffer(const HistoryFilter& filter)
 {
-    adapter_->dumpBuffer();
+    adapter_->dumpBuffer(filter);
 }
 
 /**
@@ -93,12 +94,33 @@ int OBDProfile::setProtocol(int num, bool refreshConnection)
 
 /**
  * The entry for ECU send/receive function
- * @param[in] cmdString The command
- * @return The status code
+ * @param[in] data The request bytes
+ * @param[in] len The request length
+ * @param[in] repeat The same request as the previous one
+ */
+void OBDProfile::onRequest(const uint8_t* data, int len, bool repeat)
+{
+    sendError(onRequestImpl(data, len, repeat));
+}
+
+/**
+ * The ECU send/receive function for the adapter generated requests,
+ * the error is not reported to the host
+ * @param[in] data The request bytes
+ * @param[in] len The request length
+ * @return The completion status code
+ */
+int OBDProfile::request(const uint8_t* data, int len)
+{
+    return onRequestImpl(data, len, false);
+}
+
+/**
+ * Send the error message for the request completion status
+ * @param[in] result The completion status code
  */
-void OBDProfile::onRequest(const string& cmdString)
+void OBDProfile::sendError(int result)
 {
-    int result = onRequestImpl(cmdString);
     switch(result) {
         case REPLY_CMD_WRONG:
             AdptSendReply(ErrMessage);
@@ -127,6 +149,9 @@ void OBDProfile::onRequest(const string& cmdString)
         case REPLY_WIRING_ERROR:
             AdptSendReply(Err5Message);
             break;        
+        case REPLY_STOPPED:
+            AdptSendReply(Err9Message);
+            break;
         case REPLY_NONE:
             break;
         default:
@@ -137,22 +162,20 @@ void OBDProfile::onRequest(const string& cmdString)
 
 /**
  * The actual implementation of request handler
- * @param[in] cmdString The command
+ * @param[in] data The request bytes
+ * @param[in] len The request length
+ * @param[in] repeat The same request as the previous one
  * @return The status code
  */
-int OBDProfile::onRequestImpl(const string& cmdString)
+int OBDProfile::onRequestImpl(const uint8_t* data, int len, bool repeat)
 {
-    const char* OBD_TEST_SEQ = "0100";
-    uint8_t data[OBD_IN_MSG_LEN];
+    const uint8_t OBD_TEST_SEQ[] = { 0x01, 0x00 };
 
-    // Buffer overrun check,
-    // should be less then (11 * 2) => 22 characters
-    if (cmdString.length() > (sizeof(data) * 2)) {
+    // Buffer overrun check
+    if (len > OBD_IN_MSG_LEN) {
         return REPLY_CMD_WRONG;
     }
 
-    int len = to_bytes(cmdString, data);
-
     // Valid request length?
     if (!sendLengthCheck(data, len)) {
         return REPLY_DATA_ERROR;
@@ -160,12 +183,12 @@ int OBDProfile::onRequestImpl(const string& cmdString)
 
     // The regular flow stops here
     if (adapter_->isConnected()) {
-        return adapter_->onRequest(data, len);
+        return repeat ? adapter_->onRepeatRequest(data, len) : adapter_->onRequest(data, len);
     } 
 
     // The convoluted logic
     //
-    bool sendReply = (cmdString == OBD_TEST_SEQ);
+    bool sendReply = (len == sizeof(OBD_TEST_SEQ)) && !memcmp(data, OBD_TEST_SEQ, len);
     
     int protocol = 0;
     int sts = REPLY_NO_DATA;
@@ -176,10 +199,13 @@ int OBDProfile::onRequestImpl(const string& cmdString)
     else {
         protocol = adapter_->onConnectEcu(sendReply);
         bool useAutoSP = AdapterConfig::instance()->getBoolProperty(PAR_USE_AUTO_SP);
-        if (protocol == 0 && useAutoSP) {
+        if (protocol == 0 && useAutoSP && !AdptIsAborted()) {
             protocol = autoAdapter->onConnectEcu(sendReply);
         }
     }
+    if (AdptIsAborted()) {
+        return REPLY_STOPPED;
+    }
     if (protocol) {
         setProtocol(protocol, false);
         if (!sendReply) {
@@ -218,6 +244,11 @@ void OBDProfile::closeProtocol()
     adapter_->closeProtocol();
 }
 
+void OBDProfile::onIdle()
+{
+    adapter_->onIdle();
+}
+
 /**
  * Test wiring connectivity for all protocols
  */
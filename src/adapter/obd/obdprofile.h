@@ -19,14 +19,17 @@ public:
     void getProtocolDescription() const;
     void getProtocolDescriptionNum() const;
     int setProtocol(int protocol, bool refreshConnection);
-    void dumpBuffer();
+    void dumpBuffer(const HistoryFilter& filter);
     void closeProtocol();
-    void onRequest(const util::string& cmdString);
+    void onRequest(const uint8_t* data, int len, bool repeat);
+    int request(const uint8_t* data, int len);
+    void sendError(int result);
     int getProtocol() const;
     void wiringCheck();
+    void onIdle();
 private:
     bool sendLengthCheck(const uint8_t* msg, int len);
-    int onRequestImpl(const util::string& cmdString);
+    int onRequestImpl(const uint8_t* data, int len, bool repeat);
     ProtocolAdapter* adapter_;
 };
 
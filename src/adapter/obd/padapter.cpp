@@ -36,7 +36,8 @@ ProtocolAdapter* ProtocolAdapter::getAdapter(int adapterType)
 
 /**
  * Print the current history for debug purposes
+ * @param[in] filter The frames to display
  */
-void ProtocolAdapter::dumpBuffer()
+void ProtocolAdapter::dumpBuffer(const HistoryFilter& filter)
 {
 }
@@ -10,6 +10,8 @@
 
 #include <adaptertypes.h>
 
+struct HistoryFilter;
+
 // Command results
 //
 enum ReplyTypes {
@@ -23,7 +25,8 @@ enum ReplyTypes {
     REPLY_BUS_BUSY,
     REPLY_BUS_ERROR,
     REPLY_CHKS_ERROR,
-    REPLY_WIRING_ERROR
+    REPLY_WIRING_ERROR,
+    REPLY_STOPPED
 };
 
 // Protocols
@@ -49,13 +52,15 @@ public:
     static ProtocolAdapter* getAdapter(int adapterType);
     virtual int onConnectEcu(bool sendReply) = 0;
     virtual int onRequest(const uint8_t* data, int len) = 0;
+    virtual int onRepeatRequest(const uint8_t* data, int len) { return onRequest(data, len); }
     virtual void getDescription() = 0;
     virtual void getDescriptionNum() = 0;
-    virtual void dumpBuffer();
+    virtual void dumpBuffer(const HistoryFilter& filter);
     virtual void setProtocol(int protocol) { connected_ = true; }
     virtual void closeProtocol() { connected_ = false; }
     virtual void open() { connected_ = false; }
     virtual void close() {}
+    virtual void onIdle() {}
     virtual void wiringCheck() = 0;
     virtual int getProtocol() const = 0;
     bool isConnected() const { return connected_; }
@@ -0,0 +1,120 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include "pidpacker.h"
+#include "obdprofile.h"
+
+using namespace util;
+
+//
+// SAE J1979 mode 01 PID data length, 0 - not packed. The "PIDs supported"
+// requests 00/20/40 are not mixed with the others.
+//
+static const uint8_t PidDataLen[] = {
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    0, 4, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, // 00
+    2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, // 10
+    0, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1, 1, // 20
+    1, 2, 2, 1, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2, // 30
+    0, 4, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 4, // 40
+    4, 1, 1, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 1  // 50
+};
+
+const uint8_t ObdMode01 = 0x01;
+const uint8_t ObdMode01Reply = 0x41;
+
+/**
+ * PidPacker singleton
+ * @return The PidPacker class instance
+ */
+PidPacker* PidPacker::instance()
+{
+    static PidPacker instance;
+    return &instance;
+}
+
+/**
+ * Construct PidPacker object
+ */
+PidPacker::PidPacker()
+{
+    reset();
+}
+
+/**
+ * Get the mode 01 PID data length
+ * @param[in] pid The PID
+ * @return The number of data bytes, 0 if unknown
+ */
+int PidPacker::dataLength(uint8_t pid)
+{
+    return (pid < sizeof(PidDataLen)) ? PidDataLen[pid] : 0;
+}
+
+/**
+ * Check if the request is a single PID mode 01 request with the known length
+ * @param[in] data The request bytes
+ * @param[in] len The request length
+ * @return true if can be packed, false otherwise
+ */
+bool PidPacker::isPackable(const uint8_t* data, int len)
+{
+    return len == 2 && data[0] == ObdMode01 && dataLength(data[1]) > 0;
+}
+
+/**
+ * Send the multi PID request and collect the reply
+ * @param[in] pids The PIDs to request
+ * @param[in] count The number of PIDs, up to limit()
+ * @return The completion status code
+ */
+int PidPacker::request(const uint8_t* pids, int count)
+{
+    uint8_t data[MAX_PIDS + 1];
+    data[0] = ObdMode01;
+    memcpy(data + 1, pids, count);
+
+    capture_.reset();
+    CanReply::instance()->capture(&capture_);
+    int result = OBDProfile::instance()->request(data, count + 1);
+    CanReply::instance()->capture(0);
+
+    bool valid = capture_.complete() && capture_.len <= CanReplyCapture::DATA_LEN &&
+                 capture_.data[0] == ObdMode01Reply;
+    if (result == REPLY_NONE && !valid) {
+        result = REPLY_NO_DATA;
+    }
+    if (result == REPLY_NO_DATA && count > 1) {
+        limit_ = count - 1; // ECU does not take that many
+    }
+    return result;
+}
+
+/**
+ * Get the single PID reply from the last multi PID reply
+ * @param[in] pid The PID
+ * @param[out] data The reply "41 <pid> <data>", at least 6 bytes
+ * @return The reply length, 0 if the PID is not found in the reply
+ */
+int PidPacker::reply(uint8_t pid, uint8_t* data) const
+{
+    const uint8_t* reply = capture_.data;
+    int len = capture_.len;
+
+    for (int i = 1; i < len; ) {
+        int pidLen = dataLength(reply[i]);
+        if (!pidLen || (i + 1 + pidLen) > len)
+            break;
+        if (reply[i] == pid) {
+            data[0] = ObdMode01Reply;
+            memcpy(data + 1, reply + i, pidLen + 1);
+            return pidLen + 2;
+        }
+        i += pidLen + 1;
+    }
+    return 0;
+}
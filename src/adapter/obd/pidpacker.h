@@ -0,0 +1,38 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#ifndef __PID_PACKER_H__
+#define __PID_PACKER_H__
+
+#include <adaptertypes.h>
+#include <canmsgbuffer.h>
+#include "canreply.h"
+
+//
+// Merges the single PID mode 01 requests into one multi PID request,
+// ISO 15765-4 allows up to six PIDs. The reply is split back into
+// the single PID replies by the PID data length table. The limit
+// drops if ECU does not answer the packed request.
+//
+class PidPacker {
+public:
+    const static int MAX_PIDS = 6;
+    static PidPacker* instance();
+    static int dataLength(uint8_t pid);
+    static bool isPackable(const uint8_t* data, int len);
+    void reset() { limit_ = MAX_PIDS; }
+    int limit() const { return limit_; }
+    int request(const uint8_t* pids, int count);
+    int reply(uint8_t pid, uint8_t* data) const;
+    const CanReplyCapture& captured() const { return capture_; }
+private:
+    PidPacker();
+    CanReplyCapture capture_;
+    int             limit_;
+};
+
+#endif //__PID_PACKER_H__
@@ -0,0 +1,382 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include <cstdio>
+#include <Timer.h>
+#include "pidscheduler.h"
+#include "obdprofile.h"
+#include "pidpacker.h"
+#include "canreply.h"
+#include "canpacer.h"
+
+using namespace util;
+
+/**
+ * PidScheduler singleton
+ * @return The PidScheduler class instance
+ */
+PidScheduler* PidScheduler::instance()
+{
+    static PidScheduler instance;
+    return &instance;
+}
+
+/**
+ * Construct PidScheduler object, the list is empty
+ */
+PidScheduler::PidScheduler()
+  : running_(false),
+    onChange_(false),
+    heartbeat_(0)
+{
+    clear();
+}
+
+/**
+ * Register the request in the first free slot
+ * @param[in] period The request period, ms
+ * @param[in] data The request bytes
+ * @param[in] len The request length
+ * @return The slot number, -1 if the list is full or parameters are invalid
+ */
+int PidScheduler::add(uint32_t period, const uint8_t* data, int len)
+{
+    if (period == 0 || period > MAX_PERIOD || len <= 0 || len > OBD_IN_MSG_DLEN)
+        return -1;
+
+    for (int i = 0; i < POLL_LEN; i++) {
+        PollEntry& entry = entries_[i];
+        if (entry.len)
+            continue;
+        memcpy(entry.data, data, len);
+        entry.len = len;
+        entry.period = period;
+        entry.deadline = Clock::now();
+        entry.missed = 0;
+        entry.deadband = 0;
+        entry.lastLen = 0;
+        return i;
+    }
+    return -1;
+}
+
+/**
+ * Free the slot, the scheduler stops if no requests left
+ * @param[in] slot The slot number
+ * @return true if the slot was used, false otherwise
+ */
+bool PidScheduler::remove(int slot)
+{
+    if (slot < 0 || slot >= POLL_LEN || !entries_[slot].len)
+        return false;
+
+    entries_[slot].len = 0;
+    if (nextDue(Clock::now()) < 0) {
+        running_ = false;
+    }
+    return true;
+}
+
+/**
+ * Set the request deadband for report on change mode
+ * @param[in] slot The slot number
+ * @param[in] deadband The value change to report, 0 - any change
+ * @return true if the slot is used, false otherwise
+ */
+bool PidScheduler::setDeadband(int slot, uint32_t deadband)
+{
+    if (slot < 0 || slot >= POLL_LEN || !entries_[slot].len)
+        return false;
+
+    entries_[slot].deadband = deadband;
+    return true;
+}
+
+/**
+ * Free all slots and stop the scheduler
+ */
+void PidScheduler::clear()
+{
+    memset(entries_, 0, sizeof(entries_));
+    running_ = false;
+}
+
+/**
+ * Display the registered requests, "N: <period> <request> <missed>"
+ */
+void PidScheduler::list() const
+{
+    fixed_string<REPLY_LEN> out;
+    char prefix[12];
+
+    for (int i = 0; i < POLL_LEN; i++) {
+        const PollEntry& entry = entries_[i];
+        if (!entry.len)
+            continue;
+        sprintf(prefix, "%X: %04X ", i, entry.period);
+        out = prefix;
+        to_ascii(entry.data, entry.len, out);
+        sprintf(prefix, " %u", static_cast<unsigned>(entry.missed));
+        out += prefix;
+        AdptSendReply(out);
+    }
+}
+
+/**
+ * Start polling, all requests are due immediately
+ * @return true if started, false if there are no requests
+ */
+bool PidScheduler::start()
+{
+    uint16_t now = Clock::now();
+    for (int i = 0; i < POLL_LEN; i++) {
+        entries_[i].deadline = now;
+        entries_[i].missed = 0;
+        entries_[i].lastLen = 0;
+    }
+    PidPacker::instance()->reset();
+    running_ = nextDue(now) >= 0;
+    return running_;
+}
+
+/**
+ * Find the request with the earliest deadline, the lower slot wins a tie
+ * @param[in] now The current time
+ * @return The slot number, -1 if the list is empty
+ */
+int PidScheduler::nextDue(uint16_t now) const
+{
+    int next = -1;
+    int16_t nextLeft = 0;
+
+    for (int i = 0; i < POLL_LEN; i++) {
+        const PollEntry& entry = entries_[i];
+        if (!entry.len)
+            continue;
+        int16_t left = entry.deadline - now;
+        if (next < 0 || left < nextLeft) {
+            next = i;
+            nextLeft = left;
+        }
+    }
+    return next;
+}
+
+/**
+ * Check if the request deadline has come
+ * @param[in] entry The request entry
+ * @param[in] now The current time
+ * @return true if due, false otherwise
+ */
+static bool IsDue(const PollEntry& entry, uint16_t now)
+{
+    return entry.len && static_cast<int16_t>(now - entry.deadline) >= 0;
+}
+
+/**
+ * Set the reply tag and move the deadline to the next period. The missed 
+ * deadlines are skipped and reported, the request is sent once.
+ * @param[in] slot The slot number
+ * @param[in] now The current time
+ */
+void PidScheduler::advance(int slot, uint16_t now)
+{
+    PollEntry& entry = entries_[slot];
+    uint16_t late = now - entry.deadline;
+
+    sprintf(tag_, "%X:", slot);
+    AdptSetReplyTag(tag_);
+
+    if (late >= entry.period) {
+        uint16_t skipped = late / entry.period;
+        entry.missed += skipped;
+        entry.deadline += skipped * entry.period;
+
+        char out[16];
+        sprintf(out, "MISSED %u", static_cast<unsigned>(skipped));
+        AdptSendReply(out);
+    }
+    entry.deadline += entry.period;
+}
+
+/**
+ * Send the due single PID mode 01 requests as one multi PID request,
+ * the reply is split and tagged per request
+ * @param[in] slots The slot numbers
+ * @param[in] pids The PIDs
+ * @param[in] count The number of requests
+ * @param[in] now The current time
+ */
+void PidScheduler::sendPacked(const int* slots, const uint8_t* pids, int count, uint16_t now)
+{
+    PidPacker* packer = PidPacker::instance();
+
+    for (int i = 0; i < count; i++) {
+        advance(slots[i], now);
+    }
+    AdptSetReplyTag("");
+    
+    int result = packer->request(pids, count);
+    for (int i = 0; i < count; i++) {
+        uint8_t data[6]; // "41 <pid>" and up to 4 bytes
+        int len = (result == REPLY_NONE) ? packer->reply(pids[i], data) : 0;
+        int sts = (result == REPLY_NONE && !len) ? REPLY_NO_DATA : result;
+        sendReply(slots[i], sts, packer->captured(), data, len, now);
+    }
+    AdptSetReplyTag("");
+}
+
+/**
+ * Send the request and collect the reply, report on change mode
+ * @param[in] slot The slot number
+ * @param[in] now The current time
+ */
+void PidScheduler::sendCaptured(int slot, uint16_t now)
+{
+    const PollEntry& entry = entries_[slot];
+    
+    advance(slot, now);
+    AdptSetReplyTag("");
+
+    capture_.reset();
+    CanReply::instance()->capture(&capture_);
+    int result = OBDProfile::instance()->request(entry.data, entry.len);
+    CanReply::instance()->capture(0);
+    
+    if (result == REPLY_NONE && !capture_.complete()) {
+        result = REPLY_NO_DATA;
+    }
+    if (result == REPLY_NONE && capture_.len > CanReplyCapture::DATA_LEN) {
+        result = REPLY_DATA_ERROR; // Too long to compare
+    }
+    sendReply(slot, result, capture_, capture_.data, capture_.len, now);
+    AdptSetReplyTag("");
+}
+
+/**
+ * Convert up to 4 bytes to the number
+ * @param[in] data The bytes, the most significant first
+ * @param[in] len The number of bytes
+ * @return The value
+ */
+static uint32_t ToValue(const uint8_t* data, int len)
+{
+    uint32_t val = 0;
+    for (int i = 0; i < len; i++) {
+        val = (val << 8) | data[i];
+    }
+    return val;
+}
+
+/**
+ * Check if the reply should be sent in report on change mode
+ * @param[in] entry The request entry
+ * @param[in] result The completion status code
+ * @param[in] data The reply bytes
+ * @param[in] len The reply length
+ * @param[in] now The current time
+ * @return true if the reply differs from the last one sent or the heartbeat is due
+ */
+bool PidScheduler::isChanged(const PollEntry& entry, int result, const uint8_t* data, int len, 
+                             uint16_t now) const
+{
+    if (!entry.lastLen || result != entry.lastResult)
+        return true;
+    if (heartbeat_ && static_cast<uint16_t>(now - entry.lastSent) >= heartbeat_)
+        return true;
+    if (result != REPLY_NONE)
+        return false; // The same error
+    
+    int valuePos = (len > 4) ? (len - 4) : 0;
+    if (len != entry.lastLen || memcmp(data, entry.last, valuePos))
+        return true;
+    
+    uint32_t val = ToValue(data + valuePos, len - valuePos);
+    uint32_t lastVal = ToValue(entry.last + valuePos, len - valuePos);
+    uint32_t diff = (val > lastVal) ? (val - lastVal) : (lastVal - val);
+    return diff > entry.deadband;
+}
+
+/**
+ * Send the tagged reply or the error, in report on change mode only if changed
+ * @param[in] slot The slot number
+ * @param[in] result The completion status code
+ * @param[in] reply The captured reply, the responder ID
+ * @param[in] data The reply bytes
+ * @param[in] len The reply length
+ * @param[in] now The current time
+ */
+void PidScheduler::sendReply(int slot, int result, const CanReplyCapture& reply, 
+                             const uint8_t* data, int len, uint16_t now)
+{
+    PollEntry& entry = entries_[slot];
+    
+    if (onChange_) {
+        if (!isChanged(entry, result, data, len, now))
+            return;
+        entry.lastSent = now;
+        entry.lastResult = result;
+        entry.lastLen = (result == REPLY_NONE) ? len : 1; // Mark sent
+        memcpy(entry.last, data, (result == REPLY_NONE) ? len : 0);
+    }
+    
+    sprintf(tag_, "%X:", slot);
+    AdptSetReplyTag(tag_);
+    if (result == REPLY_NONE) {
+        CanReply::instance()->sendMessage(reply.id, reply.extended, data, len);
+    }
+    else {
+        OBDProfile::instance()->sendError(result);
+    }
+}
+
+/**
+ * Send the request if its deadline has come, called from the main loop.
+ * The due single PID mode 01 requests are packed together.
+ */
+void PidScheduler::step()
+{
+    uint16_t now = Clock::now();
+    int slot = nextDue(now);
+    if (slot < 0 || !IsDue(entries_[slot], now))
+        return;
+    if (!CanPacer::instance()->allow())
+        return; // Over the bus load ceiling, hold
+
+    PidPacker* packer = PidPacker::instance();
+    const PollEntry& entry = entries_[slot];
+    
+    if (packer->limit() > 1 && PidPacker::isPackable(entry.data, entry.len)) {
+        int slots[PidPacker::MAX_PIDS];
+        uint8_t pids[PidPacker::MAX_PIDS];
+        int count = 1;
+        slots[0] = slot;
+        pids[0] = entry.data[1];
+
+        for (int i = 0; i < POLL_LEN && count < packer->limit(); i++) {
+            const PollEntry& other = entries_[i];
+            if (i == slot || !IsDue(other, now) || !PidPacker::isPackable(other.data, other.len))
+                continue;
+            if (memchr(pids, other.data[1], count))
+                continue; // The same PID goes next time
+            slots[count] = i;
+            pids[count++] = other.data[1];
+        }
+        if (count > 1) {
+            sendPacked(slots, pids, count, now);
+            return;
+        }
+    }
+    
+    if (onChange_) {
+        sendCaptured(slot, now);
+        return;
+    }
+    advance(slot, now);
+    OBDProfile::instance()->onRequest(entry.data, entry.len, false);
+    AdptSetReplyTag("");
+}
@@ -0,0 +1,75 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#ifndef __PID_SCHEDULER_H__
+#define __PID_SCHEDULER_H__
+
+#include <adaptertypes.h>
+#include "canreply.h"
+
+//
+// The request polled by the adapter with the fixed period
+//
+struct PollEntry {
+    uint8_t  data[OBD_IN_MSG_DLEN];
+    uint8_t  len;      // The request length, 0 - free slot
+    uint16_t period;   // ms
+    uint16_t deadline; // The next request time, Clock::now() based
+    uint16_t missed;   // The deadlines missed since start
+    // Report on change
+    uint32_t deadband; // The value change to report
+    uint16_t lastSent; // The time of the last reply sent
+    uint8_t  lastResult;
+    uint8_t  lastLen;  // The last reply sent, 0 - not sent since start
+    uint8_t  last[CanReplyCapture::DATA_LEN];
+};
+
+//
+// Runs the registered requests from the adapter main loop, the entry with
+// the earliest deadline goes first. The replies are tagged with
+// the slot number "N:", the late request is reported as "N:MISSED <count>".
+// The single PID mode 01 requests due together are sent packed.
+// In report on change mode the reply is sent only if it differs from
+// the last one sent by more than the request deadband, the last 4 bytes
+// are compared as a number. The heartbeat sends the reply anyway.
+// The requests are held by the pacer over the bus load ceiling.
+//
+class PidScheduler {
+public:
+    static const uint32_t MAX_PERIOD = 0x7FFF; // The Clock::now() half range
+    static PidScheduler* instance();
+    int add(uint32_t period, const uint8_t* data, int len);
+    bool remove(int slot);
+    void clear();
+    void list() const;
+    bool start();
+    void stop() { running_ = false; }
+    bool setDeadband(int slot, uint32_t deadband);
+    void setHeartbeat(uint32_t heartbeat) { heartbeat_ = heartbeat; }
+    void setOnChange(bool onChange) { onChange_ = onChange; }
+    bool running() const { return running_; }
+    void step();
+private:
+    PidScheduler();
+    int nextDue(uint16_t now) const;
+    void advance(int slot, uint16_t now);
+    void sendPacked(const int* slots, const uint8_t* pids, int count, uint16_t now);
+    void sendCaptured(int slot, uint16_t now);
+    void sendReply(int slot, int result, const CanReplyCapture& reply, 
+                   const uint8_t* data, int len, uint16_t now);
+    bool isChanged(const PollEntry& entry, int result, const uint8_t* data, int len, 
+                   uint16_t now) const;
+    const static int POLL_LEN = POLL_LIST_LEN;
+    PollEntry       entries_[POLL_LEN];
+    CanReplyCapture capture_;
+    bool            running_;
+    bool            onChange_;  // Report on change mode
+    uint16_t        heartbeat_; // ms, 0 - no heartbeat
+    char            tag_[4];
+};
+
+#endif //__PID_SCHEDULER_H__
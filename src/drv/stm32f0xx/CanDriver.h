@@ -15,19 +15,39 @@ using namespace std;
 typedef void *CAN_HANDLE_T;
 struct CanMsgBuffer;
 
+// The bus traffic counters, free running, and the error counters
+struct CanBusStatus {
+    uint32_t rxBits;     // The received frame bits, the stuffing included
+    uint32_t txBits;     // The sent frame bits
+    uint16_t rxOverflow; // The frames lost, the receive FIFO is full
+    uint16_t txOverflow; // The frames not sent, no free mailbox
+    uint16_t busOff;     // The bus-off events
+    uint8_t  tec;        // Transmit error counter
+    uint8_t  rec;        // Receive error counter
+    uint8_t  lec;        // Last error code
+};
+
 class CanDriver {
 public:
     static CanDriver* instance();
     static void configure();
+    static uint32_t bitRate();
     bool send(const CanMsgBuffer* buff);
-    bool setFilterAndMask(uint32_t filter, uint32_t mask, bool extended);
+    bool setFilterAndMask(uint32_t filter, uint32_t mask, bool extended, uint32_t filterNum = 0);
+    void clearFilter(uint32_t filterNum);
+    void setCountFilter(uint32_t filterNum);
     bool isReady() const;
+    int freeMailboxes() const;
     bool read(CanMsgBuffer* buff);
+    const CanMsgBuffer* peek() const;
+    void release();
     bool wakeUp();
     bool sleep();
     void setBitBang(bool val);
     void setBit(uint32_t val);
     uint32_t getBit();
+    void getStatus(CanBusStatus* status) const;
+    bool takeBusError();
     static CAN_HANDLE_T handle_;
 private:
     CanDriver();
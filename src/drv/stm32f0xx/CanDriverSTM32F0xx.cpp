@@ -13,6 +13,7 @@
 #include "GPIODrv.h"
 #include <canmsgbuffer.h>
 #include <led.h>
+#include <Timer.h>
 
 using namespace std;
 
@@ -24,26 +25,100 @@ const int CanTxPort = 0;
 const int CAN_AF = GPIO_AF_4;
 
 const int CAN_PRESCALER = 6 ; // For bus clock 48Mhz
+const int CAN_BIT_TQ = 16;    // SYNC + BS1 + BS2
 const uint32_t FMR_FINIT = 0x00000001;
 const uint32_t MCR_DBF   = 0x00010000;
+const uint32_t FILTER_BANKS = 0x00003FFF; // 14 banks
 static GPIO_TypeDef* const GPIOPtr[] = { GPIOA, GPIOB, GPIOC };
 
 
 // FIFO stuff
 const int FIFO_NUM = 10;
-static CanRxMsg RxFifo[FIFO_NUM];
+static CanMsgBuffer RxFifo[FIFO_NUM];
 static volatile uint32_t RxFifoFlag;
 static volatile uint32_t FifoReadPos;
 static volatile uint32_t FifoWritePos;
 
+// Bus statistics
+static volatile uint32_t RxBits;
+static volatile uint16_t RxOverflow;
+static volatile uint16_t BusOffCount;
+static volatile uint8_t  LastError;   // The last error code seen
+static volatile bool     BusError;    // Error since the last check
+static uint32_t TxBits;
+static volatile uint32_t CountFilter; // The count only filter bank, 0 - none
+static uint16_t TxOverflow;
+
+/**
+ * The frame length on the bus with the worst case bit stuffing
+ * @param[in] extended CAN 29 bit flag
+ * @param[in] dlc The data length
+ * @return The number of bits
+ */
+static uint32_t FrameBits(bool extended, uint32_t dlc)
+{
+    // SOF to CRC are stuffed, then CRC delimiter, ACK, EOF and IFS
+    uint32_t stuffed = (extended ? 54 : 34) + dlc * 8;
+    return stuffed + (stuffed - 1) / 4 + 13;
+}
 
 extern "C" void CEC_CAN_IRQHandler(void)
 {
+    // Bus-off or the frame error, the controller recovers by itself
+    if (CAN->MSR & CAN_MSR_ERRI) {
+        uint32_t esr = CAN->ESR;
+        if (esr & CAN_ESR_BOFF) {
+            BusOffCount++;
+            BusError = true;
+        }
+        if (esr & CAN_ESR_LEC) {
+            LastError = (esr & CAN_ESR_LEC) >> 4;
+            BusError = true;
+            CAN->ESR = 0; // Clear the code till the next error
+        }
+        CAN->MSR = CAN_MSR_ERRI;
+    }
+    if (!(CAN->RF0R & CAN_RF0R_FMP0))
+        return;
+
+    const CAN_FIFOMailBox_TypeDef* mailbox = &CAN->sFIFOMailBox[CAN_FIFO0];
+    uint32_t rir = mailbox->RIR;
+    uint32_t rdtr = mailbox->RDTR;
+    RxBits += FrameBits(rir & CAN_ID_EXT, rdtr & 0x0F);
+    if (CAN->RF0R & CAN_RF0R_FOVR0) {
+        RxOverflow++;
+        CAN->RF0R = CAN_RF0R_FOVR0; // Write 1 to clear, RFOM0 keeps it
+    }
+
+    // Not matched by the other filters, only counted
+    if (CountFilter && ((rdtr >> 8) & 0xFF) == CountFilter) {
+        CAN->RF0R |= CAN_RF0R_RFOM0;
+        return;
+    }
+
     // Blink LED from here, when RX operation is completed
     AdptLED::instance()->blinkRx();
 
-    CanRxMsg* msg = &RxFifo[FifoWritePos];
-    CAN_Receive(CAN, CAN_FIFO0, msg);
+    // The FIFO is full, drop the frame, the slot can be borrowed
+    if (RxFifoFlag & (0x1 << FifoWritePos)) {
+        RxOverflow++;
+        CAN->RF0R |= CAN_RF0R_RFOM0;
+        return;
+    }
+
+    // Fill the FIFO slot straight from the mailbox, the only frame copy
+    CanMsgBuffer* msg = &RxFifo[FifoWritePos];
+    msg->extended = (rir & CAN_ID_EXT) != 0;
+    msg->id = msg->extended ? (rir >> 3) : (rir >> 21);
+    msg->dlc = rdtr & 0x0F;
+    msg->msgnum = (rdtr >> 8) & 0xFF;
+    msg->time = Clock::now();
+    uint32_t* data = reinterpret_cast<uint32_t*>(msg->data);
+    data[0] = mailbox->RDLR;
+    data[1] = mailbox->RDHR;
+    
+    // Release FIFO0
+    CAN->RF0R |= CAN_RF0R_RFOM0;
 
     // Advance the FIFO next writing position
     uint32_t mask = 0x1 << FifoWritePos;
@@ -96,15 +171,31 @@ void CanDriver::configure()
     CAN_InitStruct.CAN_TXFP = DISABLE;         // Enable or disable the transmit FIFO priority.
     CAN_Init(CAN, &CAN_InitStruct);
 
-    // Enable FIFO 0 message pending Interrupt
-    CAN_ITConfig(CAN, CAN_IT_FMP0, ENABLE);
+    // Enable FIFO 0 message pending, bus-off and the frame error Interrupts
+    CAN_ITConfig(CAN, CAN_IT_FMP0 | CAN_IT_BOF | CAN_IT_LEC | CAN_IT_ERR, ENABLE);
 
     CAN->ESR = 0; 
     
+    // All banks are 32-bit mask filters, one filter per bank, so 
+    // the filter match index is the bank number even with unused banks
+    CAN->FMR |= FMR_FINIT;
+    CAN->FS1R = FILTER_BANKS;
+    CAN->FM1R = 0;
+    CAN->FMR &= ~FMR_FINIT;
+    
     // Disable Debug Freeze
     CAN->MCR &= ~MCR_DBF;
 }
 
+/**
+ * The configured bit rate
+ * @return The bit rate, bit/s
+ */
+uint32_t CanDriver::bitRate()
+{
+    return 48000000 / CAN_PRESCALER / CAN_BIT_TQ;
+}
+
 /**
  * CanDriver singleton
  * @return The pointer to CandRiver instance
@@ -141,20 +232,42 @@ bool CanDriver::send(const CanMsgBuffer* buff)
     msg.RTR   = CAN_RTR_Data;
     msg.DLC   = buff->dlc;
     memcpy(msg.Data, buff->data, 8);
+    
+    // Also sent from the periodic transmit interrupt, the mailbox selection
+    // and the counters are shared
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
     uint8_t val = CAN_Transmit(CAN, &msg);
+    if (val == CAN_TxStatus_NoMailBox) {
+        TxOverflow++;
+    }
+    else {
+        TxBits += FrameBits(buff->extended, buff->dlc);
+    }
+    __set_PRIMASK(primask);
     return (val != CAN_TxStatus_NoMailBox);
 }
 
 /**
- * Set the CAN filter for FIFO buffer
+ * The number of the empty transmit mailboxes
+ * @return 0..3
+ */
+int CanDriver::freeMailboxes() const
+{
+    uint32_t tsr = CAN->TSR;
+    return ((tsr & CAN_TSR_TME0) != 0) + ((tsr & CAN_TSR_TME1) != 0) + ((tsr & CAN_TSR_TME2) != 0);
+}
+
+/**
+ * Set the CAN filter for FIFO buffer, the received frame msgnum is the filter number
  * @parameter   filter    CAN filter value
  * @parameter   mask      CAN mask value
  * @parameter   extended  CAN extended message flag
+ * @parameter   filterNum The filter bank, 0 is for the protocol replies
  * @return  the operation completion status
  */
-bool CanDriver::setFilterAndMask(uint32_t filter, uint32_t mask, bool extended)
+bool CanDriver::setFilterAndMask(uint32_t filter, uint32_t mask, bool extended, uint32_t filterNum)
 {
-    const uint32_t filterNum = 0;
     const uint32_t filterNumberBitPos = 1 << filterNum;
     
     // Initialisation mode for the filter
@@ -189,31 +302,68 @@ bool CanDriver::setFilterAndMask(uint32_t filter, uint32_t mask, bool extended)
     return true;
 }
 
+/**
+ * Set the catch-all filter for the bus load counting, the frames are
+ * counted and dropped in ISR. It has to be the highest bank used, the
+ * lower banks go first if matched.
+ * @parameter   filterNum The filter bank
+ */
+void CanDriver::setCountFilter(uint32_t filterNum)
+{
+    setFilterAndMask(0, 0, false, filterNum);
+    CountFilter = filterNum;
+}
+
+/**
+ * Deactivate the CAN filter
+ * @parameter   filterNum The filter bank
+ */
+void CanDriver::clearFilter(uint32_t filterNum)
+{
+    CAN->FMR |= FMR_FINIT;
+    CAN->FA1R &= ~(1 << filterNum);
+    CAN->FMR &= ~FMR_FINIT;
+}
+
+/**
+ * Borrow the oldest received frame in place, the slot 
+ * is not reused by ISR until released
+ * @return  The frame pointer, nullptr if no frame
+ */
+const CanMsgBuffer* CanDriver::peek() const
+{
+    return RxFifoFlag ? &RxFifo[FifoReadPos] : nullptr;
+}
+
+/**
+ * Release the frame borrowed with peek()
+ */
+void CanDriver::release()
+{
+    // Advance the FIFO next reading position
+    uint32_t mask = 0x1 << FifoReadPos;
+
+    // The error interrupts share the vector and also fill the FIFO,
+    // masking FMP0 alone does not keep the handler out
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    RxFifoFlag &= ~mask;
+    __set_PRIMASK(primask);
+    FifoReadPos = (FifoReadPos == FIFO_NUM-1) ? 0 : FifoReadPos + 1;        
+}
+
 /**
  * Read the CAN frame from FIFO buffer
  * @return  true if read the frame / false if no frame
  */
 bool CanDriver::read(CanMsgBuffer* buff)
 { 
-    if (RxFifoFlag) {
-        const CanRxMsg* msg = &RxFifo[FifoReadPos];
-        buff->id = msg->IDE ? msg->ExtId : msg->StdId;
-        buff->extended = (msg->IDE == CAN_ID_EXT);
-        buff->dlc = msg->DLC;
-        memcpy(buff->data, msg->Data, 8);
-
-        // Advance the FIFO next reading position
-        uint32_t mask = 0x1 << FifoReadPos;
-
-        CAN_ITConfig(CAN, CAN_IT_FMP0, DISABLE);
-        RxFifoFlag &= ~mask;
-        CAN_ITConfig(CAN, CAN_IT_FMP0, ENABLE);
-        FifoReadPos = (FifoReadPos == FIFO_NUM-1) ? 0 : FifoReadPos + 1;        
-        return true;
-    }
-    else {
+    const CanMsgBuffer* msg = peek();
+    if (!msg)
         return false;
-    }
+    *buff = *msg;
+    release();
+    return true;
 }
 
 /**
@@ -267,6 +417,35 @@ void CanDriver::setBit(uint32_t bit)
     GPIOPinWrite(CanTxPort, CanTxPin, bit);
 }
 
+/**
+ * Read the bus traffic and error counters
+ * @param[out] status The counters
+ */
+void CanDriver::getStatus(CanBusStatus* status) const
+{
+    uint32_t esr = CAN->ESR;
+    status->rxBits = RxBits;
+    status->txBits = TxBits;
+    status->rxOverflow = RxOverflow;
+    status->txOverflow = TxOverflow;
+    status->busOff = BusOffCount;
+    status->tec = (esr & CAN_ESR_TEC) >> 16;
+    status->rec = (esr & CAN_ESR_REC) >> 24;
+    status->lec = LastError;
+}
+
+/**
+ * Check and reset the bus error flag, set on bus-off or the frame error
+ * @return true if the error happened since the last check
+ */
+bool CanDriver::takeBusError()
+{
+    if (!BusError)
+        return false;
+    BusError = false;
+    return true;
+}
+
 /**
  * Read CAN RX pin status
  * @return pin status, 1 if set, 0 otherwise
@@ -23,8 +23,11 @@ public:
     static void configure();
     void irqHandler();
     void init(uint32_t speed);
-    void send(const util::string& str);
+    void send(const util::string& str) { send(str.c_str(), str.length()); }
+    void send(const char* str, uint32_t len);
     void send(uint8_t ch);
+    char* txBuffer();
+    void transmit(uint32_t len);
     bool ready() const { return ready_; }
     void ready(bool val) { ready_ = val; }
     void handler(UartRecvHandler handler) { handler_ = handler; }
@@ -34,7 +37,6 @@ private:
     void rxIrqHandler();
 
     char txData_[TX_BUFFER_LEN];
-    util::string    rdData_;
     uint16_t        txLen_;
     uint16_t        txPos_;
     volatile bool   ready_;
@@ -154,20 +154,29 @@ void CmdUart::send(uint8_t ch)
 }
 
 /**
- * Send the string asynch
- * @parameter[in] str String to send
+ * Get the transmit buffer to format the output in place,
+ * waits until the previous transmission completed
+ * @return The buffer of TX_BUFFER_LEN size
  */
-void CmdUart::send(const util::string& str)
+char* CmdUart::txBuffer()
 {
     // wait for TX interrupt disabled when the previous transmission completed
     while (USART1->CR1 & USART_CR1_TCIE) {
         ;
     }
+    return txData_;
+}
 
+/**
+ * Send the transmit buffer content asynch, the buffer
+ * should be obtained with txBuffer() call
+ * @parameter[in] len The content length
+ */
+void CmdUart::transmit(uint32_t len)
+{
     // start the new transmission 
     txPos_ = 0;
-    txLen_ = str.length();
-    memcpy(txData_, str.c_str(), txLen_);
+    txLen_ = (len < TX_BUFFER_LEN) ? len : TX_BUFFER_LEN;
     if (txLen_ > 0) {
         // Initialize the transfer && Enable the USART Transmit complete interrupt
         USART_ITConfig(USART1, USART_IT_TC, ENABLE);
@@ -176,6 +185,19 @@ void CmdUart::send(const util::string& str)
     }
 }
 
+/**
+ * Send the string asynch
+ * @parameter[in] str String to send
+ * @parameter[in] len String length
+ */
+void CmdUart::send(const char* str, uint32_t len)
+{
+    char* buffer = txBuffer();
+    len = (len < TX_BUFFER_LEN) ? len : TX_BUFFER_LEN;
+    memcpy(buffer, str, len);
+    transmit(len);
+}
+
 /**
  * UART1 IRQ Handler, redirect to irqHandler
  */
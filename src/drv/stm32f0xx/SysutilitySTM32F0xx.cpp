@@ -17,9 +17,9 @@ using namespace util;
  * @paramer[in] uid UID 3 x uint32_t array
  * @return UID as a string
  */
-static string UIDToString(uint32_t uid[])
+static fixed_string<40> UIDToString(uint32_t uid[])
 {
-    string str(40);
+    fixed_string<40> str;
 
     for (int j = 0; j < 4; j++) {
         NumericType value(uid[j]);
@@ -17,7 +17,6 @@ using namespace std;
 class Timer {
 public:
     const static int TIMER0 = 0;
-    const static int TIMER1 = 1;
     static void configure();
     static Timer* instance(int timerNum);
     void start(uint32_t interval);
@@ -27,6 +26,13 @@ protected:
     TIM_TypeDef* timer_;
 };
 
+// Free running 1 ms counter for timestamps, wraps every 65.5 sec
+class Clock {
+public:
+    static void start();
+    static uint16_t now();
+};
+
 // For use with Rx/Tx LEDs
 typedef void (*PeriodicCallbackT)();
 class PeriodicTimer {
@@ -36,4 +42,15 @@ public:
     void stop();
 };
 
+// 1 ms tick interrupt with the microsecond count since the tick,
+// for the periodic CAN transmit
+class TickTimer {
+public:
+    const static uint32_t TICK_US = 1000;
+    TickTimer(PeriodicCallbackT callback);
+    void start();
+    void stop();
+    static uint32_t sinceTick();
+};
+
 #endif //__TIMER_H__
@@ -9,7 +9,7 @@
 #include "Timer.h"
 
 const uint16_t tickDiv = (SystemCoreClock / 1000);
-static TIM_TypeDef*  TimerPtr[] = { TIM3, TIM14 };
+static TIM_TypeDef*  TimerPtr[] = { TIM3 };
 
 /**
  * Configuring timers
@@ -20,11 +20,12 @@ void Timer::configure()
     RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
     RCC->APB1ENR |= RCC_APB1ENR_TIM14EN;
     RCC->APB2ENR |= RCC_APB2ENR_TIM16EN;
+    RCC->APB2ENR |= RCC_APB2ENR_TIM17EN;
 }
 
 /**
  * Construct the Timer object
- * @param[in] timerNum Logical timer number (0..2)
+ * @param[in] timerNum Logical timer number (0)
  */
 Timer::Timer(int timerNum)
 {
@@ -60,26 +61,45 @@ bool Timer::isExpired() const
 
 /**
  * Factory method to construct the Timer object
- * @param[in] timerNum Logical timer number (0..1)
+ * @param[in] timerNum Logical timer number (0)
  * @return Timer pointer
  */
 Timer* Timer::instance(int timerNum)
 {
     static Timer timer0(0);
-    static Timer timer1(1);
     
     switch (timerNum) {
       case Timer::TIMER0:
           return &timer0;
-      
-      case Timer::TIMER1: 
-          return &timer1;
         
       default:
         return 0;
     }
 }
 
+/**
+ * Start TIM14 as free running 1 ms counter
+ */
+void Clock::start()
+{
+    TIM_TimeBaseInitTypeDef  TIM_TimeBaseStruct;
+    TIM_TimeBaseStruct.TIM_Period = 0xFFFF;           // Autoload register
+    TIM_TimeBaseStruct.TIM_Prescaler = (tickDiv - 1); // Divide to 1ms
+    TIM_TimeBaseStruct.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseStruct.TIM_CounterMode = (TIM_CounterMode_Up | TIM_OPMode_Repetitive);
+    TIM_TimeBaseInit(TIM14, &TIM_TimeBaseStruct);
+    TIM14->CR1 |= TIM_CR1_CEN;
+}
+
+/**
+ * The current time
+ * @return The counter value in milliseconds
+ */
+uint16_t Clock::now()
+{
+    return TIM14->CNT;
+}
+
 static PeriodicCallbackT irqCallback;
 
 extern "C" void TIM16_IRQHandler(void)
@@ -129,3 +149,61 @@ void PeriodicTimer::stop()
 {
     TIM16->CR1 &= ~TIM_CR1_CEN;
 }
+
+static PeriodicCallbackT tickCallback;
+
+extern "C" void TIM17_IRQHandler(void)
+{
+    if (TIM17->SR & TIM_FLAG_Update) {
+        TIM17->SR &= ~TIM_FLAG_Update; // Clear TIM17 update interrupt
+        if (tickCallback) {
+            (*tickCallback)();
+        }
+    }
+}
+
+/**
+ * Construct the TickTimer instance, TIM17 counts microseconds
+ * @param[in] callback The tick interrupt handler
+ */
+TickTimer::TickTimer(PeriodicCallbackT callback)
+{
+    tickCallback = callback;
+    
+    TIM_TimeBaseInitTypeDef  TIM_TimeBaseStruct;
+    TIM_TimeBaseStruct.TIM_Period = TICK_US - 1;                     // Autoload register
+    TIM_TimeBaseStruct.TIM_Prescaler = (SystemCoreClock / 1000000 - 1); // Divide to 1us
+    TIM_TimeBaseStruct.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseStruct.TIM_CounterMode = (TIM_CounterMode_Up | TIM_OPMode_Repetitive);
+    TIM_TimeBaseInit(TIM17, &TIM_TimeBaseStruct);
+    TIM17->DIER |= TIM_IT_Update;
+    NVIC_SetPriority(TIM17_IRQn, 1); // Below CAN receive
+    NVIC_EnableIRQ(TIM17_IRQn);
+}
+
+/**
+ * Start the tick
+ */
+void TickTimer::start()
+{
+    TIM17->CNT = 0;
+    TIM17->SR  = 0; // Clear the flags
+    TIM17->CR1 |= TIM_CR1_CEN; // Enable the TIM17 time
+}
+
+/**
+ *  Stop the tick
+ */
+void TickTimer::stop()
+{
+    TIM17->CR1 &= ~TIM_CR1_CEN;
+}
+
+/**
+ * The time since the last tick, to measure the interrupt latency
+ * @return The time in microseconds
+ */
+uint32_t TickTimer::sinceTick()
+{
+    return TIM17->CNT;
+}
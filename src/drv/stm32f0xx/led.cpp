@@ -44,8 +44,8 @@ AdptLED* AdptLED::instance()
  * Constructo AdpLED object
  */
 AdptLED::AdptLED()
+  : timer_(TimerCallback)
 {
-    timer_ = new PeriodicTimer(TimerCallback);
 }
 
 /**
@@ -53,7 +53,7 @@ AdptLED::AdptLED()
  */
 void AdptLED::startTimer()
 {
-    timer_->start(TimerInteral);
+    timer_.start(TimerInteral);
 }
 
 /**
@@ -61,7 +61,7 @@ void AdptLED::startTimer()
  */
 void AdptLED::stopTimer()
 {
-    timer_->stop();
+    timer_.stop();
 }
 
 /**
@@ -9,11 +9,10 @@
 #define __LED_H__
 
 #include <cstdint>
+#include <Timer.h>
 
 using namespace std;
 
-class PeriodicTimer;
-
 class AdptLED {
 public:
     static void configure();
@@ -27,7 +26,7 @@ private:
     static void TimerCallback();
     static volatile uint32_t txCount_;
     static volatile uint32_t rxCount_;
-    PeriodicTimer* timer_;
+    PeriodicTimer timer_;
 };
 
 
@@ -6,13 +6,29 @@
  */
 
 #include <cctype>
-#include <cstdlib>
+#include <climits>
 #include "algorithms.h"
 
 using namespace std;
 
 namespace util {
 
+#define HEX_ROW(h) \
+    { h, '0' }, { h, '1' }, { h, '2' }, { h, '3' }, \
+    { h, '4' }, { h, '5' }, { h, '6' }, { h, '7' }, \
+    { h, '8' }, { h, '9' }, { h, 'A' }, { h, 'B' }, \
+    { h, 'C' }, { h, 'D' }, { h, 'E' }, { h, 'F' }
+
+//
+// Byte to ASCII hex pair, indexed by byte value
+//
+const char hex_table[256][2] = {
+    HEX_ROW('0'), HEX_ROW('1'), HEX_ROW('2'), HEX_ROW('3'),
+    HEX_ROW('4'), HEX_ROW('5'), HEX_ROW('6'), HEX_ROW('7'),
+    HEX_ROW('8'), HEX_ROW('9'), HEX_ROW('A'), HEX_ROW('B'),
+    HEX_ROW('C'), HEX_ROW('D'), HEX_ROW('E'), HEX_ROW('F')
+};
+
 /**
  * Convert string to lowercase
  * @param[in,out] str String to convert
@@ -40,7 +56,7 @@ void to_upper(string& str)
  * @param[in] str String to validate
  * @return 1 if valid, 0 otherwise
  */
-bool is_xdigits(const string& str)
+bool is_xdigits(const string_view& str)
 {
     int len = str.length();
     if (len == 0 || len % 2) {
@@ -72,17 +88,41 @@ void remove_space(string& str)
 }
 
 /**
- * Standard library stoul implementation
+ * Standard library stoul implementation, the whole string should be the number
  * @param[in] str String to perform action to
- * @param[out] pos The result length
- * @param[in] base Base
- * @return The result value
+ * @param[out] pos The number of characters processed
+ * @param[in] base Base, up to 16
+ * @return The result value, ULONG_MAX if the string is empty or has invalid digits
  */
-uint32_t stoul(const string& str, uint32_t* pos, int base)
+uint32_t stoul(const string_view& str, uint32_t* pos, int base)
 {
+    uint32_t val = 0;
+    uint32_t i = 0;
+    for (; i < str.length(); i++) {
+        int digit = to_digit(str[i]);
+        if (digit < 0 || digit >= base)
+            break;
+        val = val * base + digit;
+    }
     if (pos)
-        *pos = str.length();
-    return strtoul(str.c_str(), 0, base);;
+        *pos = i;
+    return (i == 0 || i != str.length()) ? ULONG_MAX : val;
+}
+
+/**
+ * Hex digit value
+ * @param[in] ch The character, either case
+ * @return The digit value 0-15, -1 if not a hex digit
+ */
+int to_digit(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    return -1;
 }
 
 /**
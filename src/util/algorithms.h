@@ -9,16 +9,33 @@
 #define __ALGORITHMS_H__
 
 #include "lstring.h"
+#include "stringview.h"
 
 namespace util {
     
     void to_lower(string& str);
     void to_upper(string& str);
     void remove_space(string& str);
-    uint32_t stoul(const string& str, uint32_t* pos = 0, int base = 10);
-    bool is_xdigits(const string& str);
+    uint32_t stoul(const string_view& str, uint32_t* pos = 0, int base = 10);
+    bool is_xdigits(const string_view& str);
+    int to_digit(char ch);
     char to_ascii(uint8_t byte);
     
+    extern const char hex_table[256][2];
+    
+    /**
+     * Byte to two ASCII hex characters, table lookup
+     * @param[in] byte Byte to convert
+     * @param[out] out The output position
+     * @return The position after the written characters
+     */
+    inline char* to_hex(uint8_t byte, char* out)
+    {
+        out[0] = hex_table[byte][0];
+        out[1] = hex_table[byte][1];
+        return out + 2;
+    }
+    
 }
 
 #endif //__ALGORITHMS_H__
@@ -0,0 +1,121 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "allocstats.h"
+
+using namespace std;
+
+namespace util {
+
+AllocStats AllocTracker::total_;
+AllocStats AllocTracker::command_;
+AllocStats AllocTracker::lastCommand_;
+
+/**
+ * Start counting for the new command, keep the previous command stats
+ */
+void AllocTracker::beginCommand()
+{
+    lastCommand_ = command_;
+    command_.allocs = command_.bytes = 0;
+    command_.peak = command_.inUse;
+}
+
+/**
+ * Reset the counters, the bytes in use are kept
+ */
+void AllocTracker::reset()
+{
+    uint32_t inUse = total_.inUse;
+    memset(&total_, 0, sizeof(total_));
+    total_.inUse = total_.peak = inUse;
+    command_.allocs = command_.bytes = 0;
+    command_.peak = command_.inUse;
+}
+
+/**
+ * Account the allocated block
+ * @param[in] size The block size
+ */
+void AllocTracker::onAlloc(uint32_t size)
+{
+    AllocStats* stats[] = { &total_, &command_ };
+    for (int i = 0; i < 2; i++) {
+        stats[i]->allocs++;
+        stats[i]->bytes += size;
+        stats[i]->inUse += size;
+        if (stats[i]->inUse > stats[i]->peak) {
+            stats[i]->peak = stats[i]->inUse;
+        }
+    }
+}
+
+/**
+ * Account the freed block
+ * @param[in] size The block size
+ */
+void AllocTracker::onFree(uint32_t size)
+{
+    total_.inUse -= size;
+    command_.inUse -= size;
+}
+
+} // end util namespace
+
+using namespace util;
+
+//
+// The block size is stored in front of the block, 8 bytes keep the alignment
+//
+const size_t AllocHeaderLen = 8;
+
+//
+// The throwing operator new must not return 0 and the exceptions are off,
+// so the heap exhaustion is fatal
+//
+static void* TrackedAlloc(size_t size)
+{
+    uint8_t* p = static_cast<uint8_t*>(malloc(size + AllocHeaderLen));
+    if (!p) {
+        abort();
+    }
+    *reinterpret_cast<uint32_t*>(p) = size;
+    AllocTracker::onAlloc(size);
+    return p + AllocHeaderLen;
+}
+
+static void TrackedFree(void* ptr)
+{
+    if (!ptr)
+        return;
+    uint8_t* p = static_cast<uint8_t*>(ptr) - AllocHeaderLen;
+    AllocTracker::onFree(*reinterpret_cast<uint32_t*>(p));
+    free(p);
+}
+
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+    return TrackedAlloc(size);
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc)
+{
+    return TrackedAlloc(size);
+}
+
+void operator delete(void* ptr) throw()
+{
+    TrackedFree(ptr);
+}
+
+void operator delete[](void* ptr) throw()
+{
+    TrackedFree(ptr);
+}
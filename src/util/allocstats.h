@@ -0,0 +1,45 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+//
+// Heap usage counters, updated by the global operator new/delete
+//
+
+#ifndef __ALLOC_STATS_H__ 
+#define __ALLOC_STATS_H__
+
+#include <cstdint>
+
+using namespace std;
+
+namespace util {
+
+struct AllocStats {
+    uint32_t allocs;    // Number of allocations
+    uint32_t bytes;     // Total bytes allocated
+    uint32_t inUse;     // Bytes allocated and not freed yet
+    uint32_t peak;      // The highest inUse value
+};
+
+class AllocTracker {
+public:
+    static void beginCommand();
+    static const AllocStats& total() { return total_; }
+    static const AllocStats& command() { return command_; }
+    static const AllocStats& lastCommand() { return lastCommand_; }
+    static void reset();
+    static void onAlloc(uint32_t size);
+    static void onFree(uint32_t size);
+private:
+    static AllocStats total_;       // Since the last reset
+    static AllocStats command_;     // The current command
+    static AllocStats lastCommand_; // The previous command
+};
+
+}
+
+#endif //__ALLOC_STATS_H__
@@ -12,7 +12,7 @@ using namespace std;
 
 
 CanMsgBuffer::CanMsgBuffer() 
-: id(0), extended(false), dlc(0), msgnum(0)
+: id(0), time(0), dlc(0), extended(0), dir(0), msgnum(0)
 {
     memset(data, 0, sizeof (data));
 }
@@ -26,6 +26,9 @@ CanMsgBuffer::CanMsgBuffer(uint32_t _id, bool _extended, uint8_t _dlc,
     uint8_t _data5, 
     uint8_t _data6,
     uint8_t _data7) 
+  : time(0),
+    dir(0),
+    msgnum(0)
 {
     id = _id;
     extended = _extended;
@@ -13,7 +13,8 @@
 using namespace std;
 
 //
-// To exchange messages with CAN controller
+// To exchange messages with CAN controller. The same 16 byte record
+// is filled by the receive ISR, kept in the history and formatted.
 //
 
 struct CanMsgBuffer {
@@ -29,10 +30,12 @@ struct CanMsgBuffer {
         uint8_t _data6 = DefaultByte,
         uint8_t _data7 = DefaultByte);
     uint32_t id;
-    bool    extended;
-    uint8_t dlc;
-    uint8_t data[8];
-    uint8_t msgnum;
+    uint8_t  data[8];      // Word aligned
+    uint16_t time;         // Timestamp, ms
+    uint8_t  dlc      : 4;
+    uint8_t  extended : 1;
+    uint8_t  dir      : 1; // History only, 1 if sent
+    uint8_t  msgnum;       // The filter match index
 };
 
 #endif //__CAN_MSG_BUFFER_H__
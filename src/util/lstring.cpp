@@ -27,6 +27,7 @@ void string::init(uint32_t size)
     allocatedLength_ = size > STRING_SIZE ? size : STRING_SIZE;
     allocatedLength_++;
     data_ = new char[allocatedLength_]; // Including null terminator
+    fixed_ = false;
 }
 
 string::string(uint32_t size)
@@ -36,6 +37,18 @@ string::string(uint32_t size)
     length_ = 0;
 }
 
+//
+// Use the buffer provided by fixed_string, size excluding null terminator
+//
+string::string(char* buffer, uint32_t size)
+{
+    data_ = buffer;
+    allocatedLength_ = size + 1;
+    fixed_ = true;
+    data_[0] = 0;
+    length_ = 0;
+}
+
 //
 // Validate the string memory overrun, throws exception
 //
@@ -72,7 +85,9 @@ string::string(uint32_t count, char ch)
 
 string::~string()
 {
-    delete[] data_; 
+    if (!fixed_) {
+        delete[] data_; 
+    }
 }
 
 void string::resize(uint32_t count)
@@ -50,11 +50,14 @@ public:
     char& operator[](uint32_t pos) { return data_[pos]; }
     string& operator=(const string& str);
     string& operator=(const char* s);
+protected:
+    string(char* buffer, uint32_t size);
 private:
     void init(uint32_t size);
     char* data_;
     uint16_t length_;
     uint16_t allocatedLength_;
+    bool     fixed_; // Not allocated, data_ points to the derived class buffer
 #ifdef LSTRING_VALIDATE
     void validate(uint32_t size);
 #endif
@@ -69,6 +72,23 @@ string operator+(char ch, const string& rhs);
 string operator+(const string& lhs, const char* rhs);
 string operator+(const string& lhs, char ch);
 
+//
+// The string with inline storage, no heap allocation
+//
+template<uint32_t N>
+class fixed_string : public string {
+public:
+    fixed_string() : string(buffer_, N) {}
+    fixed_string(const char* s) : string(buffer_, N) { string::operator=(s); }
+    fixed_string(const string& str) : string(buffer_, N) { string::operator=(str); }
+    fixed_string(const fixed_string& str) : string(buffer_, N) { string::operator=(str); }
+    fixed_string& operator=(const string& str) { string::operator=(str); return *this; }
+    fixed_string& operator=(const fixed_string& str) { string::operator=(str); return *this; }
+    fixed_string& operator=(const char* s) { string::operator=(s); return *this; }
+private:
+    char buffer_[N + 1]; // Including null terminator
+};
+
 }
 
 #endif //__LSTRING_H__
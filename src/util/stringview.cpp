@@ -0,0 +1,53 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+#include <cstring>
+#include "stringview.h"
+
+using namespace std;
+    
+namespace util {
+
+string_view::string_view(const char* s)
+{
+    data_ = s;
+    length_ = strlen(s);
+}
+
+string_view string_view::substr(uint32_t pos, uint32_t count) const
+{
+    uint32_t p = (pos > length_) ? length_ : pos;
+    uint32_t l = (count > length_ - p) ? (length_ - p) : count;
+    return string_view(data_ + p, l);
+}
+
+int string_view::compare(const char* s) const
+{
+    uint32_t len = strlen(s);
+    int cmp = strncmp(data_, s, (len < length_) ? len : length_);
+    if (cmp != 0)
+        return cmp;
+    return (length_ < len) ? -1 : (length_ > len) ? 1 : 0;
+}
+
+bool string_view::starts_with(const char* s) const
+{
+    uint32_t len = strlen(s);
+    return (len <= length_) && (memcmp(data_, s, len) == 0);
+}
+
+bool operator==(const string_view& lhs, const char* rhs)
+{
+    return lhs.compare(rhs) == 0;
+}
+
+bool operator!=(const string_view& lhs, const char* rhs)
+{
+    return lhs.compare(rhs) != 0;
+}
+
+} // end util namespace
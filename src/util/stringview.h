@@ -0,0 +1,46 @@
+/**
+ * See the file LICENSE for redistribution information.
+ *
+ * Copyright (c) 2009-2016 ObdDiag.Net. All rights reserved.
+ *
+ */
+
+//
+// Non-owning string slice, pointer + length
+//
+
+#ifndef __STRING_VIEW_H__ 
+#define __STRING_VIEW_H__
+
+#include <cstdint>
+#include "lstring.h"
+
+using namespace std;
+
+namespace util {
+
+class string_view {
+public:
+    const static uint32_t npos = 0xFFFFFFFF;
+    string_view() : data_(""), length_(0) {}
+    string_view(const char* s);
+    string_view(const char* s, uint32_t count) : data_(s), length_(count) {}
+    string_view(const string& str) : data_(str.c_str()), length_(str.length()) {}
+    const char* data() const { return data_; }
+    bool empty() const { return (length_ == 0); }
+    uint32_t length() const { return length_; }
+    string_view substr(uint32_t pos, uint32_t count = npos) const;
+    int compare(const char* s) const;
+    bool starts_with(const char* s) const;
+    char operator[](uint32_t pos) const { return data_[pos]; }
+private:
+    const char* data_;
+    uint32_t    length_;
+};
+
+bool operator==(const string_view& lhs, const char* rhs);
+bool operator!=(const string_view& lhs, const char* rhs);
+
+}
+
+#endif //__STRING_VIEW_H__